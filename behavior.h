@@ -0,0 +1,280 @@
+/**
+ * File: behavior.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Lizard behavior classes. Originally every lizard slept, ate and crossed
+ * with the same uniform timings. A behavior mix assigns each lizard one
+ * of the classes below, in proportion to a population share, so the gate
+ * designs can be measured under skewed and bursty traffic.
+ *
+ *   uniform  the original timings (default)
+ *   fast     crosses in half of CROSS_SECONDS
+ *   slow     takes twice CROSS_SECONDS to cross
+ *   poisson  exponential sleep times, i.e. Poisson arrivals at the gate
+ *   bursty   mostly short naps with occasional long sleeps, so arrivals
+ *            come in bursts
+ *   heavy    Pareto distributed (heavy-tailed) eating times
+ *
+ * A mix is given as a comma separated list of class=share pairs, e.g.
+ * "uniform=50,fast=20,slow=20,bursty=10". Shares are relative weights.
+ */
+#ifndef BEHAVIOR_H
+#define BEHAVIOR_H
+
+#include <math.h>   // For log and pow
+#include <stdint.h> // For fixed width integers
+#include <stdio.h>  // For printf
+#include <stdlib.h> // For strtod
+#include <string.h> // For strncmp
+
+#include <atomic> // For per-class statistics
+#include <chrono> // For fractional sleeps
+#include <thread> // For this_thread::sleep_for
+
+// Shape of a random duration
+enum Distribution {
+  DIST_UNIFORM,     // 1 + floor(u * max), the original formula
+  DIST_EXPONENTIAL, // Exponential with the given mean
+  DIST_BURSTY,      // Short exponential naps, occasionally a long one
+  DIST_PARETO       // Pareto with minimum 1 second, capped at 20 * max
+};
+
+// A random duration in seconds
+struct Duration {
+  Distribution shape;
+  double       param; // max for uniform/pareto, mean otherwise
+};
+
+// One behavior class
+struct BehaviorClass {
+  const char *name;
+  Duration    sleep;      // Time spent sleeping before heading out
+  Duration    eat;        // Time spent eating in the monkey grass
+  double      crossScale; // Multiplier on CROSS_SECONDS
+};
+
+#define NUM_BEHAVIORS  6
+#define BEHAVIOR_NAMES "uniform, fast, slow, poisson, bursty, heavy"
+#define PARETO_ALPHA   1.5 // Tail index of heavy eaters (finite mean, infinite variance)
+#define BURST_CHANCE   0.8 // Chance a bursty lizard only naps briefly
+
+/**
+ * Small per-lizard random number generator (xorshift64*). Each lizard owns
+ * one, so lizards no longer contend on the lock inside random().
+ */
+class Rng {
+  uint64_t _state;
+
+  public:
+    explicit Rng(uint64_t seed = 1) { reseed(seed); }
+
+    /**
+     * Restarts the sequence. The seed is scrambled with splitmix64 so that
+     * neighboring seeds give unrelated sequences.
+     */
+    void reseed(uint64_t seed) {
+      seed += 0x9e3779b97f4a7c15ull;
+      seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ull;
+      seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebull;
+      _state = (seed ^ (seed >> 31)) | 1;
+    }
+
+    uint64_t next() {
+      _state ^= _state >> 12;
+      _state ^= _state << 25;
+      _state ^= _state >> 27;
+      return _state * 0x2545f4914f6cdd1dull;
+    }
+
+    // Uniform in [0, 1)
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    uint64_t state() const { return _state; }
+    void setState(uint64_t state) { _state = state; }
+};
+
+/**
+ * Draws one duration in seconds.
+ */
+inline double drawDuration(const Duration &duration, Rng &rng) {
+  double u = rng.uniform();
+
+  switch(duration.shape) {
+    case DIST_UNIFORM:
+      return 1 + (int)(u * duration.param);
+    case DIST_EXPONENTIAL:
+      return -log(1.0 - u) * duration.param;
+    case DIST_BURSTY:
+      // Naps average a tenth of the mean; long sleeps make up the rest
+      if(u < BURST_CHANCE) {
+        return -log(1.0 - rng.uniform()) * duration.param * 0.1;
+      }
+      return -log(1.0 - rng.uniform()) * duration.param *
+             (1.0 - BURST_CHANCE * 0.1) / (1.0 - BURST_CHANCE);
+    case DIST_PARETO: {
+      double seconds = 1.0 / pow(1.0 - u, 1.0 / PARETO_ALPHA);
+      return seconds < 20 * duration.param ? seconds : 20 * duration.param;
+    }
+  }
+  return duration.param;
+}
+
+/**
+ * Sleeps for a fractional number of seconds.
+ */
+inline void sleepFor(double seconds) {
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+/**
+ * Population shares of each behavior class plus per-class statistics.
+ */
+class BehaviorMix {
+  BehaviorClass         _classes[NUM_BEHAVIORS];   // The built-in classes
+  double                _shares[NUM_BEHAVIORS];    // Relative population shares
+  std::atomic<uint64_t> _crossings[NUM_BEHAVIORS]; // Crossings finished per class
+  std::atomic<uint64_t> _waitMicros[NUM_BEHAVIORS];// Gate wait per class
+  double                _total;                    // Sum of the shares
+  bool                  _custom;                   // A mix was given with -m
+
+  public:
+    /**
+     * Builds the built-in classes around the world's base timings.
+     *
+     * @param maxSleep - MAX_LIZARD_SLEEP of the program.
+     * @param maxEat   - MAX_LIZARD_EAT of the program.
+     */
+    BehaviorMix(int maxSleep, int maxEat) : _total(1.0), _custom(false) {
+      double meanSleep = (1 + maxSleep) / 2.0;
+      const BehaviorClass classes[NUM_BEHAVIORS] = {
+        { "uniform", { DIST_UNIFORM, (double)maxSleep }, { DIST_UNIFORM, (double)maxEat }, 1.0 },
+        { "fast",    { DIST_UNIFORM, (double)maxSleep }, { DIST_UNIFORM, (double)maxEat }, 0.5 },
+        { "slow",    { DIST_UNIFORM, (double)maxSleep }, { DIST_UNIFORM, (double)maxEat }, 2.0 },
+        { "poisson", { DIST_EXPONENTIAL, meanSleep },    { DIST_UNIFORM, (double)maxEat }, 1.0 },
+        { "bursty",  { DIST_BURSTY, meanSleep },         { DIST_UNIFORM, (double)maxEat }, 1.0 },
+        { "heavy",   { DIST_UNIFORM, (double)maxSleep }, { DIST_PARETO, (double)maxEat },  1.0 }
+      };
+
+      for(int i = 0; i < NUM_BEHAVIORS; i++) {
+        _classes[i] = classes[i];
+        _shares[i] = i == 0 ? 1.0 : 0.0;
+        _crossings[i] = 0;
+        _waitMicros[i] = 0;
+      }
+    }
+
+    /**
+     * Parses a "class=share,..." list.
+     *
+     * @return false if a class name is unknown or no share is positive.
+     */
+    bool parse(const char *spec) {
+      double total = 0;
+      for(int i = 0; i < NUM_BEHAVIORS; i++) {
+        _shares[i] = 0;
+      }
+
+      while(*spec) {
+        int found = -1;
+        for(int i = 0; i < NUM_BEHAVIORS; i++) {
+          size_t length = strlen(_classes[i].name);
+          if(strncmp(spec, _classes[i].name, length) == 0 && spec[length] == '=') {
+            found = i;
+            spec += length + 1;
+            break;
+          }
+        }
+        if(found < 0) {
+          return false;
+        }
+
+        char *end;
+        _shares[found] = strtod(spec, &end);
+        if(end == spec || _shares[found] < 0 || (*end && *end != ',')) {
+          return false;
+        }
+        total += _shares[found];
+        spec = *end ? end + 1 : end;
+      }
+
+      _custom = true;
+      _total = total;
+      return total > 0;
+    }
+
+    /**
+     * Returns the class of lizard id out of population lizards. Classes
+     * are dealt out by cumulative share, so every class gets exactly its
+     * share of the population (up to rounding).
+     */
+    const BehaviorClass *classFor(int id, int population) const {
+      double position = (id + 0.5) / population * _total;
+      for(int i = 0; i < NUM_BEHAVIORS; i++) {
+        if(position < _shares[i]) {
+          return &_classes[i];
+        }
+        position -= _shares[i];
+      }
+      return &_classes[0];
+    }
+
+    /**
+     * Returns the smallest crossScale of any class in the mix. Lizards
+     * classFor() cannot place fall back to the first class, so it counts
+     * too.
+     */
+    double minCrossScale() const {
+      double scale = _classes[0].crossScale;
+      for(int i = 1; i < NUM_BEHAVIORS; i++) {
+        if(_shares[i] > 0 && _classes[i].crossScale < scale) {
+          scale = _classes[i].crossScale;
+        }
+      }
+      return scale;
+    }
+
+    /**
+     * Counts one finished crossing of a lizard of the given class.
+     */
+    void countCrossing(const BehaviorClass *behavior, uint64_t waitMicros) {
+      int index = (int)(behavior - _classes);
+      _crossings[index].fetch_add(1, std::memory_order_relaxed);
+      _waitMicros[index].fetch_add(waitMicros, std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns the crossings counted so far, over all classes.
+     */
+    uint64_t totalCrossings() const {
+      uint64_t total = 0;
+      for(int i = 0; i < NUM_BEHAVIORS; i++) {
+        total += _crossings[i].load(std::memory_order_relaxed);
+      }
+      return total;
+    }
+
+    /**
+     * Prints crossings and mean gate wait per class when a mix was given.
+     */
+    void printSummary() const {
+      if(!_custom) {
+        return;
+      }
+
+      printf("\n%-10s %8s %12s %14s\n", "class", "share", "crossings", "mean wait ms");
+      for(int i = 0; i < NUM_BEHAVIORS; i++) {
+        uint64_t crossings = _crossings[i].load();
+        if(_shares[i] <= 0) {
+          continue;
+        }
+        printf("%-10s %8.2f %12llu %14.1f\n", _classes[i].name, _shares[i],
+               (unsigned long long)crossings,
+               crossings ? _waitMicros[i].load() / 1e3 / crossings : 0.0);
+      }
+      fflush(stdout);
+    }
+};
+
+#endif // BEHAVIOR_H
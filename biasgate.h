@@ -0,0 +1,192 @@
+/**
+ * File: biasgate.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Direction bias for the direction gate of lizardsUni, after biased
+ * reader-writer locks (BRAVO). When nearly all traffic goes one way,
+ * every lizard still takes direction_mutex twice per crossing just to
+ * learn that the driveway is going its way. With the bias on (-b), the
+ * gate favors the direction it is going while nobody waits on the other
+ * side. A lizard going the favored way claims a slot of its own in a
+ * table of cache-line sized slots (picked by its id) and walks on; it
+ * never touches the mutex or a line another lizard writes to, apart
+ * from the crossing counters the cats read.
+ *
+ * A lizard arriving from the other side revokes the bias under the
+ * mutex: it clears the favored direction, so new lizards take the mutex
+ * again, and scans the table. Lizards still holding a slot finish their
+ * crossing; the last one out sees the bias is gone and flips the gate
+ * under the mutex like any other last lizard. Only a flip pays for the
+ * revocation, and to keep revocations from piling up the gate does not
+ * favor a direction again until BIAS_INHIBIT times the cost of the last
+ * revocation has passed.
+ */
+#ifndef BIASGATE_H
+#define BIASGATE_H
+
+#include <stdint.h> // For fixed width integers
+#include <stdio.h>  // For printf
+
+#include <atomic> // For the favored direction and the slots
+
+#include "crosslog.h" // For monotonicMicros
+
+#define BIAS_SLOTS   64 // Slots lizards going the favored way can claim
+#define BIAS_LINE    64 // Bytes per slot, so slots don't share a cache line
+#define BIAS_INHIBIT  9 // Revocation costs to wait before favoring a direction again
+
+class DirectionBias {
+  // One slot; only the lizard holding it writes to the line
+  struct alignas(BIAS_LINE) Slot {
+    std::atomic<uint32_t> taken;    // 1 while a lizard crosses through this slot
+    uint64_t              admitted; // Lizards that crossed through this slot
+  };
+
+  Slot                                _slots[BIAS_SLOTS];
+  alignas(BIAS_LINE) std::atomic<int> _favored; // Way the gate favors, -1 for none
+  bool                                _on;      // Bias enabled (-b)
+
+  // Guarded by the gate's mutex
+  uint64_t _inhibitUntil;  // No new bias before this monotonicMicros()
+  uint64_t _slow;          // Lizards the gate let in under the mutex
+  uint64_t _revocations;   // Biases taken back by a lizard from the other side
+  uint64_t _revokeMicros;  // Time spent revoking
+
+  public:
+    DirectionBias() : _favored(-1), _on(false), _inhibitUntil(0), _slow(0), _revocations(0),
+                      _revokeMicros(0) {
+      for(Slot &slot : _slots) {
+        slot.taken.store(0, std::memory_order_relaxed);
+        slot.admitted = 0;
+      }
+    }
+
+    void enable() { _on = true; }
+    bool isOn() const { return _on; }
+
+    /**
+     * Whether the gate currently favors a direction.
+     */
+    bool isBiased() const { return _favored.load() >= 0; }
+
+    /**
+     * Forgets the favored direction for a new world. Statistics are kept.
+     */
+    void reset() {
+      _favored.store(-1);
+      _inhibitUntil = 0;
+    }
+
+    /**
+     * Lets a lizard walk on without the mutex if its way is favored.
+     *
+     * @param way    - 0 for sago to monkey grass, 1 for the way back.
+     * @param lizard - Id of the lizard, which picks its slot.
+     * @return The slot the lizard holds until leave(), or -1 if it has to
+     *         take the mutex.
+     */
+    int tryEnter(int way, uint32_t lizard) {
+      if(_favored.load(std::memory_order_relaxed) != way) {
+        return -1;
+      }
+
+      // Claim our slot, then check the bias was not revoked meanwhile;
+      // a revoker clears the bias before it scans the slots
+      int index = (int)(lizard % BIAS_SLOTS);
+      Slot &slot = _slots[index];
+      uint32_t free = 0;
+      if(!slot.taken.compare_exchange_strong(free, 1)) {
+        return -1;
+      }
+      if(_favored.load() != way) {
+        slot.taken.store(0);
+        return -1;
+      }
+      slot.admitted++;
+      return index;
+    }
+
+    /**
+     * Gives up a slot once its lizard is off the driveway.
+     *
+     * @return true if the bias was revoked, in which case the lizard may
+     *         be the last one out and must check for a flip under the mutex.
+     */
+    bool leave(int slot, int way) {
+      _slots[slot].taken.store(0);
+      return _favored.load() != way;
+    }
+
+    /**
+     * Favors a way after a lizard walked on under the mutex with nobody
+     * waiting on the other side. Call with the gate's mutex held.
+     */
+    void favor(int way) {
+      if(_on && _favored.load(std::memory_order_relaxed) < 0 &&
+         monotonicMicros() >= _inhibitUntil) {
+        _favored.store(way);
+      }
+    }
+
+    /**
+     * Counts lizards the gate let in under the mutex. Call with the
+     * gate's mutex held.
+     */
+    void countSlow(int lizards) { _slow += lizards; }
+
+    /**
+     * Takes the bias back for a lizard that has to wait for a flip. Call
+     * with the gate's mutex held.
+     */
+    void revoke() {
+      if(_favored.load(std::memory_order_relaxed) < 0) {
+        return;
+      }
+      uint64_t start = monotonicMicros();
+      _favored.store(-1);
+      drained(); // The scan of the slots is what a revocation costs
+      uint64_t cost = monotonicMicros() - start;
+      _revocations++;
+      _revokeMicros += cost;
+      _inhibitUntil = start + cost * (BIAS_INHIBIT + 1);
+    }
+
+    /**
+     * Whether no lizard holds a slot. Once the bias is revoked slots only
+     * empty, so a true answer stays true until the next bias.
+     */
+    bool drained() const {
+      for(const Slot &slot : _slots) {
+        if(slot.taken.load()) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /**
+     * Prints how many lizards went through the slots and what the
+     * revocations cost.
+     */
+    void printSummary() const {
+      if(!_on) {
+        return;
+      }
+
+      uint64_t fast = 0;
+      for(const Slot &slot : _slots) {
+        fast += slot.admitted;
+      }
+      uint64_t total = fast + _slow;
+      printf("\ndirection bias: %llu of %llu entries (%.1f%%) without the mutex, "
+             "%llu revocations (%.1f us each)\n", (unsigned long long)fast,
+             (unsigned long long)total, total ? 100.0 * fast / total : 0.0,
+             (unsigned long long)_revocations,
+             _revocations ? (double)_revokeMicros / _revocations : 0.0);
+      fflush(stdout);
+    }
+};
+
+#endif // BIASGATE_H
@@ -0,0 +1,276 @@
+/**
+ * File: classgate.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Multi-class driveway gate that replaces driveway_sem. Every lizard
+ * belongs to a service class (e.g. emergency and normal lizards). A class
+ * may reserve spots on the driveway that only its own lizards can use;
+ * the remaining spots are shared. When lizards of several classes are
+ * waiting for a shared spot, the next one is picked by weighted fair
+ * queueing (start-time fair queueing over per-class virtual clocks): a
+ * class with weight 4 is admitted four times as often as a class with
+ * weight 1 while both are backlogged, and FIFO order is kept inside a
+ * class.
+ *
+ * With a single class and nothing reserved the gate behaves exactly like
+ * a FIFO counting semaphore with the same capacity.
+ *
+ * The gate also keeps a latency histogram per class so the programs can
+ * report wait percentiles for each service class.
+ */
+#ifndef CLASSGATE_H
+#define CLASSGATE_H
+
+#include <semaphore.h> // For parking waiting lizards
+#include <stdint.h>    // For fixed width integers
+#include <stdio.h>     // For printf
+
+#include <mutex> // For guarding the gate
+
+#include "histogram.h" // For per-class latency percentiles
+
+#define MAX_SERVICE_CLASSES 4 // Most service classes one gate can hold
+
+class ClassGate {
+  // A lizard parked at the gate, on the waiting lizard's stack
+  struct Waiter {
+    sem_t   admitted; // Posted once the gate has admitted this lizard
+    Waiter *next;     // Next lizard of the same class
+  };
+
+  // One service class
+  struct Lane {
+    const char      *name;        // Printed in the summary
+    double           weight;      // Share of the shared spots while backlogged
+    int              reserved;    // Spots only this class may use
+    int              inUse;       // Lizards of this class on the driveway
+    double           virtualTime; // Start tag of the next admission
+    Waiter          *head;        // FIFO of waiting lizards
+    Waiter          *tail;
+    LatencyHistogram waits;       // Wait of every crossing of this class
+  };
+
+  Lane       _lanes[MAX_SERVICE_CLASSES];
+  int        _numClasses;  // Classes added so far
+  int        _capacity;    // Total spots on the driveway
+  int        _sharedInUse; // Shared spots taken (by lizards beyond their reservation)
+  double     _clock;       // Virtual time of the last admission
+  std::mutex _mutex;       // Guards everything above
+
+  public:
+    /**
+     * @param capacity - Lizards allowed on the driveway at once.
+     */
+    explicit ClassGate(int capacity) : _numClasses(0), _capacity(capacity) {
+      reset();
+    }
+
+    /**
+     * Adds a service class.
+     *
+     * @param name     - Name printed in the summary.
+     * @param weight   - Relative weight for the shared spots.
+     * @param reserved - Spots held back for this class alone.
+     * @return Index of the class, or -1 if the gate is full.
+     */
+    int addClass(const char *name, double weight, int reserved) {
+      if(_numClasses == MAX_SERVICE_CLASSES) {
+        return -1;
+      }
+      Lane &lane = _lanes[_numClasses];
+      lane.name = name;
+      lane.weight = weight;
+      lane.reserved = reserved;
+      lane.inUse = 0;
+      lane.virtualTime = 0;
+      lane.head = lane.tail = nullptr;
+      return _numClasses++;
+    }
+
+    /**
+     * Changes how many lizards fit on the driveway. Call between worlds.
+     */
+    void setCapacity(int capacity) { _capacity = capacity; }
+
+    /**
+     * Empties the driveway and the queues for a new world. Latency
+     * statistics are kept across worlds.
+     */
+    void reset() {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for(int i = 0; i < _numClasses; i++) {
+        _lanes[i].inUse = 0;
+        _lanes[i].virtualTime = 0;
+        _lanes[i].head = _lanes[i].tail = nullptr;
+      }
+      _sharedInUse = 0;
+      _clock = 0;
+    }
+
+    /**
+     * Blocks until a lizard of the given class may step onto the driveway.
+     */
+    void enter(int cls) {
+      Waiter waiter;
+      Waiter *admitted = nullptr;
+      Lane &lane = _lanes[cls];
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // Walk straight on if nobody is waiting and there is room for us
+        if(!anyoneWaiting() && canAdmit(lane)) {
+          lane.virtualTime = lane.virtualTime > _clock ? lane.virtualTime : _clock;
+          admit(lane);
+          return;
+        }
+
+        // Otherwise queue up; an idle class starts at the current clock
+        if(!lane.head && lane.virtualTime < _clock) {
+          lane.virtualTime = _clock;
+        }
+        sem_init(&waiter.admitted, 0, 0);
+        waiter.next = nullptr;
+        if(lane.tail) {
+          lane.tail->next = &waiter;
+        } else {
+          lane.head = &waiter;
+        }
+        lane.tail = &waiter;
+        admitted = dispatch();
+      }
+
+      wake(admitted);
+      sem_wait(&waiter.admitted);
+      sem_destroy(&waiter.admitted);
+    }
+
+    /**
+     * Frees the spot of a lizard of the given class and admits whoever
+     * is next.
+     */
+    void leave(int cls) {
+      Waiter *admitted;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Lane &lane = _lanes[cls];
+        lane.inUse--;
+        if(lane.inUse >= lane.reserved) {
+          _sharedInUse--;
+        }
+        admitted = dispatch();
+      }
+      wake(admitted);
+    }
+
+    /**
+     * Counts how long a lizard of the given class waited to cross.
+     */
+    void countWait(int cls, uint64_t micros) {
+      _lanes[cls].waits.record(micros);
+    }
+
+    /**
+     * Prints wait percentiles per class when there is more than one.
+     */
+    void printSummary() const {
+      if(_numClasses < 2) {
+        return;
+      }
+
+      printf("\n%-10s %6s %8s %9s %10s %10s %10s %10s %10s\n", "service", "weight",
+             "reserved", "crossings", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms");
+      for(int i = 0; i < _numClasses; i++) {
+        const Lane &lane = _lanes[i];
+        printf("%-10s %6.1f %8d %9llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", lane.name,
+               lane.weight, lane.reserved, (unsigned long long)lane.waits.count(),
+               lane.waits.percentile(0.50) / 1e3, lane.waits.percentile(0.90) / 1e3,
+               lane.waits.percentile(0.99) / 1e3, lane.waits.percentile(0.999) / 1e3,
+               lane.waits.max() / 1e3);
+      }
+      fflush(stdout);
+    }
+
+  private:
+    bool anyoneWaiting() const {
+      for(int i = 0; i < _numClasses; i++) {
+        if(_lanes[i].head) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * A lizard fits if its class has a reserved spot left or a shared
+     * spot is free.
+     */
+    bool canAdmit(const Lane &lane) const {
+      int shared = _capacity;
+      for(int i = 0; i < _numClasses; i++) {
+        shared -= _lanes[i].reserved;
+      }
+      return lane.inUse < lane.reserved || _sharedInUse < shared;
+    }
+
+    /**
+     * Takes a spot for one lizard of the lane and advances its clock.
+     */
+    void admit(Lane &lane) {
+      if(lane.inUse >= lane.reserved) {
+        _sharedInUse++;
+      }
+      lane.inUse++;
+      _clock = lane.virtualTime;
+      lane.virtualTime += 1.0 / lane.weight;
+    }
+
+    /**
+     * Admits waiting lizards while there is room, always taking the head
+     * of the admissible class with the smallest virtual time.
+     *
+     * @return The admitted waiters, linked through next, to be woken
+     *         once the mutex is released.
+     */
+    Waiter *dispatch() {
+      Waiter *admitted = nullptr;
+
+      for(;;) {
+        Lane *best = nullptr;
+        for(int i = 0; i < _numClasses; i++) {
+          Lane &lane = _lanes[i];
+          if(lane.head && canAdmit(lane) && (!best || lane.virtualTime < best->virtualTime)) {
+            best = &lane;
+          }
+        }
+        if(!best) {
+          return admitted;
+        }
+
+        Waiter *waiter = best->head;
+        best->head = waiter->next;
+        if(!best->head) {
+          best->tail = nullptr;
+        }
+        admit(*best);
+        waiter->next = admitted;
+        admitted = waiter;
+      }
+    }
+
+    /**
+     * Posts every admitted waiter. next is read before posting, since a
+     * woken lizard's waiter goes away with its stack frame.
+     */
+    static void wake(Waiter *admitted) {
+      while(admitted) {
+        Waiter *next = admitted->next;
+        sem_post(&admitted->admitted);
+        admitted = next;
+      }
+    }
+};
+
+#endif // CLASSGATE_H
@@ -0,0 +1,252 @@
+/**
+ * File: counters.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Data-race-free numCrossing* counters. Both directions are packed into
+ * one 64-bit atomic word, so entering or leaving the driveway is a single
+ * relaxed fetch_add and a cat (or a debug print) gets a consistent view
+ * of both directions from a single load. No mutex is involved.
+ *
+ * For the high-rate modes there is also a sharded variant (make
+ * SHARDED=1): every thread updates its own cache line and readers add
+ * the shards up, retrying until two passes agree so that the sum is
+ * still a consistent snapshot. That read touches every shard, so
+ * enter() and leave() return nothing; only callers that look at the
+ * counters use enterAndRead() and leaveAndRead().
+ *
+ * Directions are indexed like the crossing log: 0 is sago -> monkey
+ * grass, 1 is monkey grass -> sago.
+ */
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#ifndef SHARDED_COUNTERS
+#define SHARDED_COUNTERS 0
+#endif
+
+#include <stdint.h> // For fixed width integers, INT32_MAX
+
+#include <atomic> // For the counter words
+#include <thread> // For hardware_concurrency
+
+#define COUNTER_SHARDS     64 // Upper bound on shards of the sharded variant
+#define CACHE_LINE_BYTES   64 // Padding that keeps shards off each other's lines
+
+/**
+ * Both counters as seen at one instant.
+ */
+struct CrossingSnapshot {
+  int sago2MonkeyGrass; // numCrossingSago2MonkeyGrass
+  int monkeyGrass2Sago; // numCrossingMonkeyGrass2Sago
+
+  int operator[](int direction) const {
+    return direction == 0 ? sago2MonkeyGrass : monkeyGrass2Sago;
+  }
+  int total() const { return sago2MonkeyGrass + monkeyGrass2Sago; }
+};
+
+/**
+ * Both counters in one atomic word: sago -> grass in the upper 32 bits,
+ * grass -> sago in the lower 32 bits.
+ */
+class PackedCrossingCounters {
+  std::atomic<uint64_t> _packed;
+
+  public:
+    static const int MAX_LIZARDS = INT32_MAX; // Lizards the counters can tell apart
+
+    PackedCrossingCounters() : _packed(0) {}
+
+    /**
+     * Counts a lizard onto the driveway.
+     */
+    void enter(int direction) { _packed.fetch_add(unit(direction), std::memory_order_relaxed); }
+
+    /**
+     * Counts a lizard off the driveway.
+     */
+    void leave(int direction) { _packed.fetch_sub(unit(direction), std::memory_order_relaxed); }
+
+    /**
+     * Counts a lizard onto the driveway.
+     *
+     * @return Both counters right after this lizard was counted.
+     */
+    CrossingSnapshot enterAndRead(int direction) {
+      uint64_t delta = unit(direction);
+      return unpack(_packed.fetch_add(delta, std::memory_order_relaxed) + delta);
+    }
+
+    /**
+     * Counts a lizard off the driveway.
+     *
+     * @return Both counters right after this lizard left.
+     */
+    CrossingSnapshot leaveAndRead(int direction) {
+      uint64_t delta = unit(direction);
+      return unpack(_packed.fetch_sub(delta, std::memory_order_relaxed) - delta);
+    }
+
+    /**
+     * Returns both counters from a single wait-free load.
+     */
+    CrossingSnapshot snapshot() const {
+      return unpack(_packed.load(std::memory_order_relaxed));
+    }
+
+    void reset() { _packed.store(0, std::memory_order_relaxed); }
+
+  private:
+    static uint64_t unit(int direction) { return direction == 0 ? 1ull << 32 : 1ull; }
+
+    static CrossingSnapshot unpack(uint64_t packed) {
+      CrossingSnapshot snapshot = { (int)(uint32_t)(packed >> 32), (int)(uint32_t)packed };
+      return snapshot;
+    }
+};
+
+/**
+ * One packed word per shard. Each word also carries a 32-bit version in
+ * its upper half that every update bumps, which lets readers detect that
+ * a shard changed between two passes. The counts use 16 bits each.
+ *
+ * A lizard is not always counted off on the shard that counted it on:
+ * in lizardsUni the lizard that flips the gate counts a whole convoy
+ * onto its own shard, and every lizard of the convoy counts itself off
+ * on its own. A single shard's fields can therefore wrap below zero and
+ * borrow from the field above. The low 32 bits of each word are still
+ * right modulo 2^32, so sum() adds them up modulo 2^32 and only then
+ * splits the total into directions. That split is exact as long as the
+ * total in each direction is below 2^16. A lizard is counted at most
+ * once at a time, and the programs refuse to run more than MAX_LIZARDS
+ * lizards with these counters, so even a broken gate that lets every
+ * lizard on at once stays below it. A borrow out of the low half only
+ * shifts the version, which readers just compare between passes; every
+ * update still changes the word.
+ */
+class ShardedCrossingCounters {
+  struct alignas(CACHE_LINE_BYTES) Shard {
+    std::atomic<uint64_t> word;
+  };
+
+  Shard                 _shards[COUNTER_SHARDS];
+  unsigned              _numShards;
+  std::atomic<unsigned> _nextShard; // Round-robin shard assignment
+
+  public:
+    static const int MAX_LIZARDS = 0xffff; // Most a 16-bit count can hold
+
+    ShardedCrossingCounters() : _nextShard(0) {
+      unsigned cores = std::thread::hardware_concurrency();
+      _numShards = cores == 0 ? 1 : (cores < COUNTER_SHARDS ? cores : COUNTER_SHARDS);
+      reset();
+    }
+
+    /**
+     * Counts a lizard onto the driveway, touching only its own shard.
+     */
+    void enter(int direction) {
+      myShard().word.fetch_add(VERSION + unit(direction), std::memory_order_relaxed);
+    }
+
+    /**
+     * Counts a lizard off the driveway, touching only its own shard.
+     */
+    void leave(int direction) {
+      myShard().word.fetch_add(VERSION - unit(direction), std::memory_order_relaxed);
+    }
+
+    /**
+     * Counts a lizard onto the driveway, then reads every shard.
+     *
+     * @return Both counters some time after this lizard was counted.
+     */
+    CrossingSnapshot enterAndRead(int direction) {
+      enter(direction);
+      return snapshot();
+    }
+
+    /**
+     * Counts a lizard off the driveway, then reads every shard.
+     *
+     * @return Both counters some time after this lizard left.
+     */
+    CrossingSnapshot leaveAndRead(int direction) {
+      leave(direction);
+      return snapshot();
+    }
+
+    /**
+     * Sums the shards. A pass that saw every shard unchanged since the
+     * previous pass (same versions) is a consistent snapshot.
+     */
+    CrossingSnapshot snapshot() const {
+      uint64_t previous[COUNTER_SHARDS];
+      collect(previous);
+      for(;;) {
+        uint64_t current[COUNTER_SHARDS];
+        collect(current);
+
+        bool stable = true;
+        for(unsigned i = 0; i < _numShards && stable; i++) {
+          stable = current[i] == previous[i];
+        }
+        if(stable) {
+          return sum(current);
+        }
+        for(unsigned i = 0; i < _numShards; i++) {
+          previous[i] = current[i];
+        }
+      }
+    }
+
+    void reset() {
+      for(unsigned i = 0; i < COUNTER_SHARDS; i++) {
+        _shards[i].word.store(0, std::memory_order_relaxed);
+      }
+    }
+
+  private:
+    static const uint64_t VERSION = 1ull << 32;
+    static_assert(MAX_LIZARDS < 1 << 16, "a direction's count must fit its 16 bits");
+
+    static uint64_t unit(int direction) { return direction == 0 ? 1ull << 16 : 1ull; }
+
+    /**
+     * Returns the calling thread's shard. Threads are dealt shards round
+     * robin on first use and keep them.
+     */
+    Shard &myShard() {
+      static thread_local unsigned shard = _nextShard.fetch_add(1) % _numShards;
+      return _shards[shard];
+    }
+
+    void collect(uint64_t words[]) const {
+      for(unsigned i = 0; i < _numShards; i++) {
+        words[i] = _shards[i].word.load(std::memory_order_acquire);
+      }
+    }
+
+    /**
+     * Adds up the counts of every shard modulo 2^32, so fields that
+     * wrapped on one shard cancel against the others.
+     */
+    CrossingSnapshot sum(const uint64_t words[]) const {
+      uint32_t total = 0;
+      for(unsigned i = 0; i < _numShards; i++) {
+        total += (uint32_t)words[i];
+      }
+      CrossingSnapshot snapshot = { (int)(total >> 16), (int)(total & 0xffff) };
+      return snapshot;
+    }
+};
+
+#if SHARDED_COUNTERS
+typedef ShardedCrossingCounters CrossingCounters;
+#else
+typedef PackedCrossingCounters CrossingCounters;
+#endif
+
+#endif // COUNTERS_H
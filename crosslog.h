@@ -0,0 +1,405 @@
+/**
+ * File: crosslog.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Append-only binary log of every driveway crossing, used for offline
+ * analysis of long runs where printing to cout is far too slow.
+ *
+ * Lizards hand finished crossings to CrossingLog::record(), which only
+ * copies the record into a buffer of the calling thread. A full buffer
+ * is handed off in one go: the lock is taken once per
+ * CROSSLOG_THREAD_RECORDS crossings and the batch is appended to the
+ * active in-memory block. A thread hands off what is left in its buffer
+ * when it exits, so close the log only after the lizards are joined.
+ * When a block fills up the two blocks are swapped and a background
+ * writer thread encodes the full one and appends it to the file, so
+ * lizards never wait on disk unless the writer falls a whole block
+ * behind.
+ *
+ * Each block is stored column by column: lizard ids, a direction bitmap,
+ * enter times as deltas, crossing durations and wait times, all as
+ * LEB128 varints. The encoded columns are then deflated with zlib. The
+ * crosslogdump tool reads the file back through mmap.
+ *
+ * File layout:
+ *   CrossLogFileHeader
+ *   { CrossLogBlockHeader, compressed columns } ...
+ */
+#ifndef CROSSLOG_H
+#define CROSSLOG_H
+
+#include <stdint.h>   // For fixed width integers
+#include <stdio.h>    // For FILE
+#include <string.h>   // For memcpy
+#include <time.h>     // For clock_gettime
+#include <zlib.h>     // For block compression
+
+#include <algorithm>          // For sorting a block by enter time, min
+#include <condition_variable> // For waking the writer thread
+#include <mutex>              // For guarding the active block
+#include <thread>             // For the writer thread
+#include <vector>             // For block storage
+
+#define CROSSLOG_MAGIC          0x474f4c58534f5243ull // "CROSSLOG"
+#define CROSSLOG_VERSION        1
+#define CROSSLOG_BLOCK_RECORDS  65536 // Crossings per compressed block
+#define CROSSLOG_THREAD_RECORDS 256   // Crossings a thread buffers before handing them off
+
+// One finished crossing; times are microseconds since the log was opened
+struct CrossingRecord {
+  uint32_t lizard;    // Id of the lizard that crossed
+  uint32_t direction; // 0 = sago -> monkey grass, 1 = monkey grass -> sago
+  uint64_t enter;     // When the lizard stepped onto the driveway
+  uint64_t exit;      // When it reached the other side
+  uint64_t wait;      // How long it waited at the gate before entering
+};
+
+// Written once at the start of the file
+struct CrossLogFileHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t blockRecords;
+};
+
+// Precedes every compressed block
+struct CrossLogBlockHeader {
+  uint32_t records;        // Number of crossings in the block
+  uint32_t rawBytes;       // Size of the encoded columns before deflate
+  uint32_t compressedBytes;// Size of the deflated payload that follows
+  uint32_t reserved;
+  uint64_t firstEnter;     // Enter time of the first (earliest) crossing
+  uint64_t lastEnter;      // Enter time of the last crossing
+};
+
+/**
+ * Returns CLOCK_MONOTONIC in microseconds.
+ */
+inline uint64_t monotonicMicros() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000ull + (uint64_t)now.tv_nsec / 1000;
+}
+
+/**
+ * Appends value to out as an unsigned LEB128 varint.
+ */
+inline void putVarint(std::vector<uint8_t> &out, uint64_t value) {
+  while(value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+/**
+ * Reads one varint starting at in and advances in past it. Returns false
+ * if the varint runs past end.
+ */
+inline bool getVarint(const uint8_t *&in, const uint8_t *end, uint64_t &value) {
+  value = 0;
+  for(int shift = 0; in < end && shift < 64; shift += 7) {
+    uint8_t byte = *in++;
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if(!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Encodes a block of crossings (already sorted by enter time) into its
+ * columnar form.
+ */
+inline void encodeCrossingColumns(const std::vector<CrossingRecord> &block,
+                                  std::vector<uint8_t> &out) {
+  out.clear();
+
+  for(const CrossingRecord &r : block) {
+    putVarint(out, r.lizard);
+  }
+
+  uint8_t bits = 0;
+  for(size_t i = 0; i < block.size(); i++) {
+    bits |= (uint8_t)((block[i].direction & 1) << (i % 8));
+    if(i % 8 == 7 || i + 1 == block.size()) {
+      out.push_back(bits);
+      bits = 0;
+    }
+  }
+
+  uint64_t previous = block.empty() ? 0 : block[0].enter;
+  for(const CrossingRecord &r : block) {
+    putVarint(out, r.enter - previous);
+    previous = r.enter;
+  }
+
+  for(const CrossingRecord &r : block) {
+    putVarint(out, r.exit - r.enter);
+  }
+
+  for(const CrossingRecord &r : block) {
+    putVarint(out, r.wait);
+  }
+}
+
+/**
+ * Decodes the columns of one block back into records. Returns false if
+ * the columns are truncated.
+ */
+inline bool decodeCrossingColumns(const uint8_t *in, size_t size, uint32_t records,
+                                  uint64_t firstEnter, std::vector<CrossingRecord> &block) {
+  const uint8_t *end = in + size;
+  uint64_t value;
+
+  block.resize(records);
+  for(uint32_t i = 0; i < records; i++) {
+    if(!getVarint(in, end, value)) return false;
+    block[i].lizard = (uint32_t)value;
+  }
+
+  if((size_t)(end - in) < (records + 7) / 8) return false;
+  for(uint32_t i = 0; i < records; i++) {
+    block[i].direction = (in[i / 8] >> (i % 8)) & 1;
+  }
+  in += (records + 7) / 8;
+
+  uint64_t enter = firstEnter;
+  for(uint32_t i = 0; i < records; i++) {
+    if(!getVarint(in, end, value)) return false;
+    enter += value;
+    block[i].enter = enter;
+  }
+
+  for(uint32_t i = 0; i < records; i++) {
+    if(!getVarint(in, end, value)) return false;
+    block[i].exit = block[i].enter + value;
+  }
+
+  for(uint32_t i = 0; i < records; i++) {
+    if(!getVarint(in, end, value)) return false;
+    block[i].wait = value;
+  }
+  return true;
+}
+
+/**
+ * Double-buffered crossing log with per-thread buffers and a background
+ * writer thread.
+ */
+class CrossingLog {
+  // Crossings of one thread not yet handed to the log
+  struct ThreadBuffer {
+    CrossingLog                *log;     // Log the crossings belong to
+    std::vector<CrossingRecord> records;
+
+    ThreadBuffer() : log(NULL) {}
+    ~ThreadBuffer() { handOff(); }
+
+    void handOff() {
+      if(log && !records.empty()) {
+        log->append(records.data(), records.size());
+      }
+      records.clear();
+    }
+  };
+
+  FILE                       *_file;        // Output file, NULL while closed
+  uint64_t                    _origin;      // monotonicMicros() at open
+  std::vector<CrossingRecord> _active;      // Block threads hand their crossings to
+  std::vector<CrossingRecord> _flushing;    // Block the writer is encoding
+  bool                        _full;        // _flushing holds a block to write
+  bool                        _closing;     // Writer should drain and exit
+  bool                        _failed;      // A block could not be written
+  std::mutex                  _mutex;       // Guards everything above
+  std::condition_variable     _writerCV;    // Writer waits for a full block
+  std::condition_variable     _swapCV;      // Lizards wait for a free block
+  std::thread                 _writer;      // Background writer thread
+
+  public:
+    CrossingLog() : _file(NULL), _origin(0), _full(false), _closing(false), _failed(false) {}
+    ~CrossingLog() { close(); }
+
+    /**
+     * Opens the log for writing and starts the writer thread.
+     *
+     * @param path - File to create or truncate.
+     * @return true if the file could be opened and its header written.
+     */
+    bool open(const char *path) {
+      _file = fopen(path, "wb");
+      if(!_file) {
+        return false;
+      }
+
+      CrossLogFileHeader header = { CROSSLOG_MAGIC, CROSSLOG_VERSION, CROSSLOG_BLOCK_RECORDS };
+      if(fwrite(&header, sizeof(header), 1, _file) != 1) {
+        fclose(_file);
+        _file = NULL;
+        return false;
+      }
+
+      _active.reserve(CROSSLOG_BLOCK_RECORDS);
+      _flushing.reserve(CROSSLOG_BLOCK_RECORDS);
+      _origin = monotonicMicros();
+      _closing = false;
+      _failed = false;
+      _writer = std::thread(&CrossingLog::writerThread, this);
+      return true;
+    }
+
+    /**
+     * Returns true while the log is open.
+     */
+    bool isOpen() const { return _file != NULL; }
+
+    /**
+     * Converts a monotonicMicros() reading into log time.
+     */
+    uint64_t since(uint64_t micros) const { return micros - _origin; }
+
+    /**
+     * Appends one crossing to the calling thread's buffer, and hands the
+     * buffer to the log once it is full. Blocks only if both blocks of
+     * the log are full.
+     */
+    void record(const CrossingRecord &crossing) {
+      static thread_local ThreadBuffer buffer;
+      if(buffer.log != this) {
+        buffer.handOff();
+        buffer.log = this;
+        buffer.records.reserve(CROSSLOG_THREAD_RECORDS);
+      }
+      buffer.records.push_back(crossing);
+      if(buffer.records.size() >= CROSSLOG_THREAD_RECORDS) {
+        buffer.handOff();
+      }
+    }
+
+    /**
+     * Writes out the partial block, stops the writer and closes the file.
+     *
+     * @return false if part of the log could not be written.
+     */
+    bool close() {
+      if(!_file) {
+        return true;
+      }
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closing = true;
+        _writerCV.notify_one();
+      }
+      _writer.join();
+      if(fclose(_file) != 0 && !_failed) {
+        perror("crossing log");
+        _failed = true;
+      }
+      _file = NULL;
+      return !_failed;
+    }
+
+  private:
+    /**
+     * Appends a batch of crossings to the active block, swapping blocks
+     * with the writer each time the active one fills up.
+     */
+    void append(const CrossingRecord *records, size_t count) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if(!_file || _closing) {
+        return;
+      }
+      while(count > 0) {
+        size_t room = std::min(count, (size_t)CROSSLOG_BLOCK_RECORDS - _active.size());
+        _active.insert(_active.end(), records, records + room);
+        records += room;
+        count -= room;
+        if(_active.size() >= CROSSLOG_BLOCK_RECORDS) {
+          _swapCV.wait(lock, [this] { return !_full; });
+          _active.swap(_flushing);
+          _full = true;
+          _writerCV.notify_one();
+        }
+      }
+    }
+
+    /**
+     * Encodes and appends full blocks until the log is closed, then
+     * writes whatever is left in the active block. After a failed write
+     * later blocks are dropped, so lizards still never wait on a broken
+     * file.
+     */
+    void writerThread() {
+      std::vector<uint8_t> columns;
+      std::vector<uint8_t> compressed;
+      std::unique_lock<std::mutex> lock(_mutex);
+
+      for(;;) {
+        _writerCV.wait(lock, [this] { return _full || _closing; });
+
+        if(_full) {
+          // Encode outside the lock so lizards keep filling _active
+          lock.unlock();
+          bool failed = _failed || !writeBlock(_flushing, columns, compressed);
+          _flushing.clear();
+          lock.lock();
+          _failed = failed;
+          _full = false;
+          _swapCV.notify_all();
+        } else {
+          if(!_failed) {
+            _failed = !writeBlock(_active, columns, compressed);
+          }
+          if(!_failed && fflush(_file) != 0) {
+            perror("crossing log");
+            _failed = true;
+          }
+          _active.clear();
+          return;
+        }
+      }
+    }
+
+    /**
+     * Sorts, encodes, deflates and appends one block.
+     *
+     * @return false, after saying why, if the block could not be written.
+     */
+    bool writeBlock(std::vector<CrossingRecord> &block, std::vector<uint8_t> &columns,
+                    std::vector<uint8_t> &compressed) {
+      if(block.empty()) {
+        return true;
+      }
+
+      // Crossings are recorded on exit; order them by entry for the deltas
+      std::sort(block.begin(), block.end(),
+                [](const CrossingRecord &a, const CrossingRecord &b) { return a.enter < b.enter; });
+      encodeCrossingColumns(block, columns);
+
+      uLongf compressedBytes = compressBound(columns.size());
+      compressed.resize(compressedBytes);
+      int status = compress2(compressed.data(), &compressedBytes, columns.data(), columns.size(),
+                             Z_BEST_SPEED);
+      if(status != Z_OK) {
+        fprintf(stderr, "crossing log: cannot compress a block (zlib error %d)\n", status);
+        return false;
+      }
+
+      CrossLogBlockHeader header = {};
+      header.records = (uint32_t)block.size();
+      header.rawBytes = (uint32_t)columns.size();
+      header.compressedBytes = (uint32_t)compressedBytes;
+      header.firstEnter = block.front().enter;
+      header.lastEnter = block.back().enter;
+      if(fwrite(&header, sizeof(header), 1, _file) != 1 ||
+         fwrite(compressed.data(), 1, compressedBytes, _file) != compressedBytes) {
+        perror("crossing log");
+        return false;
+      }
+      return true;
+    }
+};
+
+#endif // CROSSLOG_H
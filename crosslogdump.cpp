@@ -0,0 +1,164 @@
+/**
+ * File: crosslogdump.cpp
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Reads a crossing log written with "lizards -l <file>" or
+ * "lizardsUni -l <file>". The file is mapped with mmap and scanned one
+ * block at a time, so even very long runs can be summarized in a few
+ * milliseconds.
+ *
+ * Usage:
+ *   crosslogdump [-c] <file>
+ *
+ *   -c   Print every crossing as CSV instead of the summary.
+ *
+ * A truncated or corrupt log is reported on stderr; whatever could be
+ * read before the damage is still printed, and the exit status is 1.
+ */
+
+// C Includes
+#include <fcntl.h>     // For open
+#include <stdio.h>     // For printf
+#include <string.h>    // For strcmp and memcpy
+#include <sys/mman.h>  // For mmap
+#include <sys/stat.h>  // For fstat
+#include <unistd.h>    // For close
+
+// C++ Includes
+#include <vector> // For decoded blocks
+
+// Project Includes
+#include "crosslog.h" // For the log format
+
+using namespace std; // Cleans up code syntax a bit
+
+/**
+ * Maps the log, decodes every block and prints either a summary or the
+ * individual crossings.
+ */
+int main(int argc, char **argv) {
+  bool csv = argc > 2 && strcmp(argv[1], "-c") == 0;
+  const char *path = argv[argc - 1];
+
+  if(argc < 2 || (argc > 2 && !csv)) {
+    fprintf(stderr, "usage: %s [-c] <file>\n", argv[0]);
+    return 1;
+  }
+
+  // Map the whole file read-only
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    perror(path);
+    return 1;
+  }
+  struct stat info;
+  if(fstat(fd, &info) < 0) {
+    perror(path);
+    close(fd);
+    return 1;
+  }
+  size_t size = (size_t)info.st_size;
+  const uint8_t *data = (const uint8_t *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  madvise((void *)data, size, MADV_SEQUENTIAL);
+
+  uint64_t started = monotonicMicros();
+
+  // Check the file header
+  const CrossLogFileHeader *header = (const CrossLogFileHeader *)data;
+  if(size < sizeof(*header) || header->magic != CROSSLOG_MAGIC ||
+     header->version != CROSSLOG_VERSION) {
+    fprintf(stderr, "%s: not a crossing log\n", path);
+    return 1;
+  }
+
+  vector<uint8_t>        columns;
+  vector<CrossingRecord> block;
+  uint64_t blocks = 0;
+  uint64_t records = 0;
+  uint64_t perDirection[2] = { 0, 0 };
+  uint64_t totalWait = 0, maxWait = 0;
+  uint64_t totalCross = 0;
+  uint64_t firstEnter = UINT64_MAX, lastExit = 0;
+
+  if(csv) {
+    printf("lizard,direction,enter_us,exit_us,wait_us\n");
+  }
+
+  // Walk the blocks; a bad block ends the walk and the exit status says so
+  size_t offset = sizeof(*header);
+  bool valid = true;
+  while(offset + sizeof(CrossLogBlockHeader) <= size) {
+    // Blocks follow each other unaligned, so copy the header out
+    CrossLogBlockHeader blockHeader;
+    memcpy(&blockHeader, data + offset, sizeof(blockHeader));
+    offset += sizeof(blockHeader);
+    if(offset + blockHeader.compressedBytes > size) {
+      fprintf(stderr, "%s: truncated block %llu\n", path, (unsigned long long)blocks);
+      valid = false;
+      break;
+    }
+
+    columns.resize(blockHeader.rawBytes);
+    uLongf rawBytes = blockHeader.rawBytes;
+    if(uncompress(columns.data(), &rawBytes, data + offset, blockHeader.compressedBytes) != Z_OK ||
+       !decodeCrossingColumns(columns.data(), rawBytes, blockHeader.records,
+                              blockHeader.firstEnter, block)) {
+      fprintf(stderr, "%s: corrupt block %llu\n", path, (unsigned long long)blocks);
+      valid = false;
+      break;
+    }
+    offset += blockHeader.compressedBytes;
+    blocks++;
+
+    for(const CrossingRecord &r : block) {
+      if(csv) {
+        printf("%u,%s,%llu,%llu,%llu\n", r.lizard, r.direction ? "grass2sago" : "sago2grass",
+               (unsigned long long)r.enter, (unsigned long long)r.exit,
+               (unsigned long long)r.wait);
+      }
+      records++;
+      perDirection[r.direction & 1]++;
+      totalWait += r.wait;
+      totalCross += r.exit - r.enter;
+      maxWait = max(maxWait, r.wait);
+      firstEnter = min(firstEnter, r.enter);
+      lastExit = max(lastExit, r.exit);
+    }
+  }
+
+  // Bytes left over that cannot hold a block header mean the log was cut short
+  if(valid && offset != size) {
+    fprintf(stderr, "%s: truncated after block %llu\n", path, (unsigned long long)blocks);
+    valid = false;
+  }
+
+  uint64_t elapsed = monotonicMicros() - started;
+  munmap((void *)data, size);
+
+  if(csv) {
+    return valid ? 0 : 1;
+  }
+
+  // Summarize the run
+  double perRecord = records ? 1.0 / records : 0.0;
+  double span = records ? (lastExit - firstEnter) / 1e6 : 0.0;
+  printf("crossings            %llu in %llu blocks\n",
+         (unsigned long long)records, (unsigned long long)blocks);
+  printf("  sago -> grass      %llu\n", (unsigned long long)perDirection[0]);
+  printf("  grass -> sago      %llu\n", (unsigned long long)perDirection[1]);
+  printf("file size            %zu bytes (%.2f bytes/crossing)\n", size, size * perRecord);
+  printf("time span            %.3f s\n", span);
+  printf("throughput           %.2f crossings/s\n", span > 0 ? records / span : 0.0);
+  printf("mean crossing        %.1f us\n", totalCross * perRecord);
+  printf("mean wait            %.1f us\n", totalWait * perRecord);
+  printf("max wait             %llu us\n", (unsigned long long)maxWait);
+  printf("scan time            %.3f ms\n", elapsed / 1e3);
+  return valid ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+/**
+ * File: driveway.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Pipelined driveway. Instead of one opaque CROSS_SECONDS sleep, the
+ * driveway is cut into K cells and a lizard walks across it one cell at a
+ * time, spending CROSS_SECONDS / K in each. A cell holds one lizard, so
+ * lizards going the same way stream across back to back, one cell apart,
+ * and up to K of them are on the driveway at once.
+ *
+ * Every cell is one atomic word holding the lizard standing in it and
+ * its direction. A lizard steps forward by claiming the next cell with a
+ * compare-and-swap and then clearing the cell behind it, so stepping
+ * never takes a lock. If the next cell is taken by a lizard going the
+ * same way, the lizard waits a fraction of a step for it to move on. If
+ * it is taken by a lizard coming the other way, the two have met head-on
+ * in that cell; cross() reports the conflict instead of waiting forever.
+ *
+ * The wait for a same-way lizard polls: the lizard sleeps a quarter of a
+ * step and tries the cell again. The lizard ahead leaves within a step,
+ * so a blocked lizard starts at most a quarter step late and tries a
+ * blocked cell about four times per step. Waking it exactly would need
+ * a lock per cell on every step.
+ *
+ * A driveway has one lane (both directions share the cells, as in
+ * lizardsUni) or two (one lane per direction, as in lizards). The gates
+ * in front of a shared lane already keep out more lizards than it has
+ * cells. With two lanes the gate only counts lizards on the whole
+ * driveway, so enterLane() also holds back lizards whose own lane is
+ * full.
+ */
+#ifndef DRIVEWAY_H
+#define DRIVEWAY_H
+
+#include <stdint.h> // For fixed width integers
+
+#include <atomic>             // For the cell words
+#include <condition_variable> // For waiting on a full lane
+#include <mutex>              // For guarding lane admission
+
+#include "behavior.h" // For sleepFor
+
+#define MAX_DRIVEWAY_CELLS 64 // Longest driveway, in cells
+#define DRIVEWAY_LINE      64 // Bytes per cell, so neighbors don't share a cache line
+
+class PipelinedDriveway {
+  // One cell: 0 when empty, else (lizard + 1) << 1 | direction
+  struct alignas(DRIVEWAY_LINE) Cell {
+    std::atomic<uint32_t> word;
+  };
+
+  Cell                    _cells[2][MAX_DRIVEWAY_CELLS]; // Indexed by lane, then cell
+  int                     _numCells;                     // Cells per lane, 0 when off
+  int                     _numLanes;                     // 1 shared lane or 2 one-way lanes
+  int                     _admitted[2];                  // Lizards let into each one-way lane
+  std::mutex              _laneMutex;                    // Guards _admitted
+  std::condition_variable _laneFree[2];                  // Lizards waiting for room in a lane
+
+  public:
+    PipelinedDriveway() : _numCells(0), _numLanes(1) { _admitted[0] = _admitted[1] = 0; }
+
+    /**
+     * Sets the shape of the driveway. Cells are cleared.
+     *
+     * @param cells - Cells per lane (1 to MAX_DRIVEWAY_CELLS), 0 to turn off.
+     * @param lanes - 1 if both directions share the cells, 2 for one lane each.
+     */
+    void configure(int cells, int lanes) {
+      _numCells = cells;
+      _numLanes = lanes;
+      clear();
+    }
+
+    bool isOn() const { return _numCells > 0; }
+
+    /**
+     * Lizards that fit on the driveway at once.
+     */
+    int capacity() const { return _numCells * _numLanes; }
+
+    /**
+     * Empties every cell and lane for a new world.
+     */
+    void clear() {
+      for(int lane = 0; lane < 2; lane++) {
+        for(int cell = 0; cell < MAX_DRIVEWAY_CELLS; cell++) {
+          _cells[lane][cell].word.store(0, std::memory_order_relaxed);
+        }
+        _admitted[lane] = 0;
+      }
+    }
+
+    /**
+     * Waits until the lizard's one-way lane has a cell to spare and
+     * counts it in. Does nothing on a shared lane or with the driveway
+     * off. Call before taking a spot at the gate, so a lizard waiting for
+     * a full lane does not hold a spot the other lane could use.
+     *
+     * @param direction - 0 for sago to monkey grass, 1 for the way back.
+     */
+    void enterLane(uint32_t direction) {
+      if(_numLanes < 2 || !isOn()) {
+        return;
+      }
+      std::unique_lock<std::mutex> lock(_laneMutex);
+      _laneFree[direction].wait(lock, [&] { return _admitted[direction] < _numCells; });
+      _admitted[direction]++;
+    }
+
+    /**
+     * Counts a lizard out of its one-way lane, letting the next one in.
+     */
+    void leaveLane(uint32_t direction) {
+      if(_numLanes < 2 || !isOn()) {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(_laneMutex);
+      _admitted[direction]--;
+      _laneFree[direction].notify_one();
+    }
+
+    /**
+     * Walks a lizard across the driveway cell by cell.
+     *
+     * @param lizard    - Id of the lizard.
+     * @param direction - 0 for sago to monkey grass (cells in increasing
+     *                    order), 1 for the way back.
+     * @param seconds   - Time the whole crossing takes with a free path.
+     * @param conflict  - Set to the word of the lizard met head-on, if any.
+     * @return false if the lizard met a lizard coming the other way.
+     */
+    bool cross(uint32_t lizard, uint32_t direction, double seconds, uint32_t &conflict) {
+      Cell *lane = _cells[_numLanes == 2 ? direction : 0];
+      uint32_t mine = (lizard + 1) << 1 | direction;
+      double step = seconds / _numCells;
+      Cell *behind = nullptr;
+
+      for(int i = 0; i < _numCells; i++) {
+        Cell *next = &lane[direction == 0 ? i : _numCells - 1 - i];
+
+        // Claim the next cell, waiting for a same-way lizard to move on
+        uint32_t occupant = 0;
+        while(!next->word.compare_exchange_weak(occupant, mine, std::memory_order_acq_rel)) {
+          if(occupant != 0 && (occupant & 1) != direction) {
+            conflict = occupant;
+            if(behind) {
+              behind->word.store(0, std::memory_order_release);
+            }
+            return false;
+          }
+          if(occupant != 0) {
+            sleepFor(step / 4);
+          }
+          occupant = 0;
+        }
+
+        // Leave the cell behind and spend a step in the new one
+        if(behind) {
+          behind->word.store(0, std::memory_order_release);
+        }
+        behind = next;
+        sleepFor(step);
+      }
+
+      behind->word.store(0, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * Lizard id stored in a cell word.
+     */
+    static uint32_t lizardOf(uint32_t word) { return (word >> 1) - 1; }
+};
+
+#endif // DRIVEWAY_H
@@ -0,0 +1,126 @@
+/**
+ * File: histogram.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Lock-free latency histogram for percentile reports. Values (in
+ * microseconds) go into log-linear buckets: one power-of-two range per
+ * leading bit, split into HISTOGRAM_SUB_BUCKETS linear sub-buckets, so
+ * every reported percentile is within about 6% of the true value no
+ * matter how long the tail is. Recording is a single relaxed fetch_add.
+ */
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h> // For fixed width integers
+
+#include <atomic> // For the bucket counters
+
+#define HISTOGRAM_SUB_BITS    4                         // log2 of the sub-buckets
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS) // Linear steps per power of two
+#define HISTOGRAM_BUCKETS     (64 * HISTOGRAM_SUB_BUCKETS)
+
+class LatencyHistogram {
+  std::atomic<uint64_t> _buckets[HISTOGRAM_BUCKETS];
+  std::atomic<uint64_t> _count;
+  std::atomic<uint64_t> _max;
+
+  public:
+    LatencyHistogram() { reset(); }
+
+    /**
+     * Counts one value.
+     */
+    void record(uint64_t value) {
+      _buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+      _count.fetch_add(1, std::memory_order_relaxed);
+
+      uint64_t seen = _max.load(std::memory_order_relaxed);
+      while(value > seen && !_max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+      }
+    }
+
+    /**
+     * Adds every value counted by another histogram.
+     */
+    void merge(const LatencyHistogram &other) {
+      for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        _buckets[i].fetch_add(other._buckets[i].load(), std::memory_order_relaxed);
+      }
+      _count.fetch_add(other._count.load(), std::memory_order_relaxed);
+      if(other._max.load() > _max.load()) {
+        _max.store(other._max.load());
+      }
+    }
+
+    uint64_t count() const { return _count.load(); }
+    uint64_t max() const { return _max.load(); }
+
+    /**
+     * Returns the value below which the given fraction of the counted
+     * values lie (the midpoint of the bucket it falls in).
+     *
+     * @param fraction - Between 0 and 1, e.g. 0.99 for p99.
+     */
+    uint64_t percentile(double fraction) const {
+      uint64_t total = _count.load();
+      if(total == 0) {
+        return 0;
+      }
+
+      uint64_t rank = (uint64_t)(fraction * total);
+      if(rank >= total) {
+        rank = total - 1;
+      }
+      uint64_t seen = 0;
+      for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += _buckets[i].load(std::memory_order_relaxed);
+        if(seen > rank) {
+          uint64_t low = lowestOf(i), high = lowestOf(i + 1);
+          uint64_t middle = low + (high - low) / 2;
+          return middle < _max.load() ? middle : _max.load();
+        }
+      }
+      return _max.load();
+    }
+
+    void reset() {
+      for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        _buckets[i].store(0, std::memory_order_relaxed);
+      }
+      _count.store(0, std::memory_order_relaxed);
+      _max.store(0, std::memory_order_relaxed);
+    }
+
+  private:
+    /**
+     * Values below HISTOGRAM_SUB_BUCKETS get a bucket each; above that,
+     * the leading bit picks the range and the next bits the step in it.
+     */
+    static int bucketOf(uint64_t value) {
+      if(value < HISTOGRAM_SUB_BUCKETS) {
+        return (int)value;
+      }
+      int top = 63 - __builtin_clzll(value);
+      int step = (int)(value >> (top - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+      return (top - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + step;
+    }
+
+    /**
+     * Smallest value that lands in the given bucket.
+     */
+    static uint64_t lowestOf(int bucket) {
+      if(bucket < HISTOGRAM_SUB_BUCKETS) {
+        return (uint64_t)bucket;
+      }
+      int top = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+      if(top > 63) {
+        return UINT64_MAX;
+      }
+      uint64_t step = (uint64_t)(bucket % HISTOGRAM_SUB_BUCKETS);
+      return (1ull << top) | (step << (top - HISTOGRAM_SUB_BITS));
+    }
+};
+
+#endif // HISTOGRAM_H
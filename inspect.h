@@ -0,0 +1,227 @@
+/**
+ * File: inspect.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Cat inspection engine. Originally a cat looked at the driveway once
+ * every 1 to 3 seconds and ended the program the first time it saw too
+ * many lizards. With inspection on (-s rate), every cat instead samples
+ * the crossing counters at the given rate and keeps going, so a run
+ * reports how often the driveway was in a bad state rather than only
+ * whether it ever was.
+ *
+ * Sampling times are exponentially distributed, so the fraction of
+ * samples that see a violation is an unbiased estimate of the fraction
+ * of time the driveway spends in violation (Poisson arrivals see time
+ * averages). Each cat keeps its own sliding window of recent samples and
+ * its own totals, and only merges them into the shared totals when the
+ * world ends. A sample is a single snapshot() of the packed counters,
+ * one wait-free atomic load, so cats never slow down lizard admission no
+ * matter how many there are. (With make SHARDED=1 the snapshot retries
+ * while shards change and is only lock-free.)
+ */
+#ifndef INSPECT_H
+#define INSPECT_H
+
+#include <math.h>   // For log
+#include <stdint.h> // For fixed width integers
+#include <stdio.h>  // For printf
+
+#include <atomic> // For the merged totals
+#include <deque>  // For the sliding window
+
+#include "behavior.h" // For Rng
+#include "counters.h" // For CrossingSnapshot
+#include "crosslog.h" // For monotonicMicros
+
+#define INSPECT_WINDOW_SECONDS 10 // Length of the sliding window
+#define INSPECT_MIN_WINDOW     10 // Samples a window needs before it counts
+
+// Bad states a cat can catch the driveway in
+enum Violation {
+  VIOLATION_OVERFULL,  // More lizards crossing than the driveway holds
+  VIOLATION_BOTH_WAYS, // Lizards crossing both ways at once (if unidirectional)
+  NUM_VIOLATIONS
+};
+
+static const char *const VIOLATION_NAMES[NUM_VIOLATIONS] = { "overfull", "both ways" };
+
+/**
+ * One cat's view: a sliding window of its latest samples and running
+ * totals. Only the owning cat touches it.
+ */
+class InspectionWindow {
+  struct Sample {
+    uint64_t at;    // monotonicMicros() of the sample
+    unsigned flags; // Bit v set if the sample saw Violation v
+  };
+
+  std::deque<Sample> _window;                       // Samples of the last window
+  uint64_t           _windowMicros;                 // Length of the window
+  uint64_t           _inWindow[NUM_VIOLATIONS];     // Violating samples in the window
+  uint64_t           _previousAt;                   // Time of the previous sample
+  unsigned           _previousFlags;                // What the previous sample saw
+
+  public:
+    uint64_t samples;                     // Samples taken
+    uint64_t observedMicros;              // Time from first to last sample
+    uint64_t violations[NUM_VIOLATIONS];  // Samples that saw each violation
+    uint64_t overMicros[NUM_VIOLATIONS];  // Estimated time spent in each violation
+    double   worstWindow[NUM_VIOLATIONS]; // Highest violating fraction of any window
+
+    explicit InspectionWindow(uint64_t windowMicros)
+      : _windowMicros(windowMicros), _previousAt(0), _previousFlags(0),
+        samples(0), observedMicros(0) {
+      for(int v = 0; v < NUM_VIOLATIONS; v++) {
+        _inWindow[v] = violations[v] = overMicros[v] = 0;
+        worstWindow[v] = 0;
+      }
+    }
+
+    /**
+     * Adds one sample taken at time at.
+     *
+     * @param flags - Bit v set if the sample saw Violation v.
+     */
+    void add(uint64_t at, unsigned flags) {
+      // The time since the previous sample counts towards what it saw
+      if(_previousAt) {
+        uint64_t interval = at - _previousAt;
+        observedMicros += interval;
+        for(int v = 0; v < NUM_VIOLATIONS; v++) {
+          if(_previousFlags & (1u << v)) {
+            overMicros[v] += interval;
+          }
+        }
+      }
+      _previousAt = at;
+      _previousFlags = flags;
+
+      // Slide the window forward
+      samples++;
+      _window.push_back({ at, flags });
+      while(_window.front().at + _windowMicros < at) {
+        for(int v = 0; v < NUM_VIOLATIONS; v++) {
+          _inWindow[v] -= (_window.front().flags >> v) & 1;
+        }
+        _window.pop_front();
+      }
+
+      for(int v = 0; v < NUM_VIOLATIONS; v++) {
+        unsigned seen = (flags >> v) & 1;
+        violations[v] += seen;
+        _inWindow[v] += seen;
+        if(_window.size() >= INSPECT_MIN_WINDOW) {
+          double fraction = (double)_inWindow[v] / _window.size();
+          if(fraction > worstWindow[v]) {
+            worstWindow[v] = fraction;
+          }
+        }
+      }
+    }
+};
+
+/**
+ * Settings and merged results of every cat's inspections.
+ */
+class CatInspector {
+  double                _rate;                        // Samples per second per cat, 0 when off
+  std::atomic<uint64_t> _cats;                        // Windows merged
+  std::atomic<uint64_t> _samples;
+  std::atomic<uint64_t> _observedMicros;
+  std::atomic<uint64_t> _violations[NUM_VIOLATIONS];
+  std::atomic<uint64_t> _overMicros[NUM_VIOLATIONS];
+  std::atomic<uint64_t> _worstWindow[NUM_VIOLATIONS]; // Parts per million
+
+  public:
+    CatInspector() : _rate(0), _cats(0), _samples(0), _observedMicros(0) {
+      for(int v = 0; v < NUM_VIOLATIONS; v++) {
+        _violations[v] = _overMicros[v] = _worstWindow[v] = 0;
+      }
+    }
+
+    /**
+     * Turns inspection on.
+     *
+     * @param rate - Samples per second each cat takes.
+     */
+    void configure(double rate) { _rate = rate; }
+
+    bool isOn() const { return _rate > 0; }
+
+    uint64_t windowMicros() const { return INSPECT_WINDOW_SECONDS * 1000000ull; }
+
+    /**
+     * Seconds until a cat's next sample.
+     */
+    double nextInterval(Rng &rng) const {
+      return -log(1.0 - rng.uniform()) / _rate;
+    }
+
+    /**
+     * Classifies one snapshot of the counters and adds it to a window.
+     *
+     * @param capacity       - Lizards the driveway holds.
+     * @param unidirectional - Whether crossing both ways is a violation.
+     */
+    void sample(InspectionWindow &window, const CrossingSnapshot &crossing, int capacity,
+                bool unidirectional) const {
+      unsigned flags = 0;
+      if(crossing.total() > capacity) {
+        flags |= 1u << VIOLATION_OVERFULL;
+      }
+      if(unidirectional && crossing.sago2MonkeyGrass > 0 && crossing.monkeyGrass2Sago > 0) {
+        flags |= 1u << VIOLATION_BOTH_WAYS;
+      }
+      window.add(monotonicMicros(), flags);
+    }
+
+    /**
+     * Adds a cat's totals to the shared ones. Called once per cat per world.
+     */
+    void merge(const InspectionWindow &window) {
+      _cats.fetch_add(1);
+      _samples.fetch_add(window.samples);
+      _observedMicros.fetch_add(window.observedMicros);
+      for(int v = 0; v < NUM_VIOLATIONS; v++) {
+        _violations[v].fetch_add(window.violations[v]);
+        _overMicros[v].fetch_add(window.overMicros[v]);
+
+        uint64_t worst = (uint64_t)(window.worstWindow[v] * 1e6);
+        uint64_t seen = _worstWindow[v].load();
+        while(worst > seen && !_worstWindow[v].compare_exchange_weak(seen, worst)) {
+        }
+      }
+    }
+
+    /**
+     * Prints how often the cats caught each violation.
+     */
+    void printSummary() const {
+      if(!isOn()) {
+        return;
+      }
+
+      uint64_t cats = _cats.load(), samples = _samples.load();
+      double observed = _observedMicros.load() / 1e6;
+      double wall = cats ? observed / cats : 0.0; // Seconds each cat watched, on average
+
+      printf("\n%llu cats took %llu samples over %.1f s (%.1f samples/s per cat)\n",
+             (unsigned long long)cats, (unsigned long long)samples, wall,
+             observed > 0 ? samples / observed : 0.0);
+      printf("%-10s %10s %10s %12s %14s %16s\n", "violation", "samples", "% samples",
+             "per minute", "% time above", "worst window %");
+      for(int v = 0; v < NUM_VIOLATIONS; v++) {
+        uint64_t seen = _violations[v].load();
+        printf("%-10s %10llu %10.3f %12.2f %14.3f %16.2f\n", VIOLATION_NAMES[v],
+               (unsigned long long)seen, samples ? 100.0 * seen / samples : 0.0,
+               wall > 0 ? seen / (double)cats / (wall / 60) : 0.0,
+               observed > 0 ? 100.0 * _overMicros[v].load() / 1e6 / observed : 0.0,
+               _worstWindow[v].load() / 1e4);
+      }
+      fflush(stdout);
+    }
+};
+
+#endif // INSPECT_H
@@ -19,13 +19,29 @@
 #include <string.h>
 #include <unistd.h>
 #include <semaphore.h>
+#include <getopt.h> // NN DS
 
 // C++ Inlcudes
+#include <atomic> // NN DS
 #include <iostream>
 #include <mutex>
 #include <thread>
 #include <vector>
 
+// Project Includes
+#include "behavior.h"  // NN DS
+#include "classgate.h" // NN DS
+#include "counters.h"  // NN DS
+#include "crosslog.h"  // NN DS
+#include "driveway.h"  // NN DS
+#include "inspect.h"   // NN DS
+#include "loadgen.h"   // NN DS
+#include "logger.h"    // NN DS
+#include "occupancy.h" // NN DS
+#include "profile.h"   // NN DS
+#include "sweep.h"     // NN DS
+#include "threads.h"   // NN DS
+
 // Usings
 using namespace std;
 
@@ -64,10 +80,37 @@ using namespace std;
 // Number of seconds it takes to cross the driveway
 #define CROSS_SECONDS        2
 
+// Gate weight of emergency lizards (normal lizards have 1) NN DS
+#define EMERGENCY_WEIGHT     4
+
+// Driveway spots reserved for emergency lizards NN DS
+#define EMERGENCY_SPOTS      1
+
+// Service classes at the driveway gate NN DS
+enum Service {
+  NORMAL_SERVICE,   // shares the driveway with everyone
+  EMERGENCY_SERVICE // has reserved spots and a higher gate weight (-e)
+};
+
 // Declare global variables here
 mutex cout_mutex; // Ensure debug output is not being overwritten
-mutex crossing_mutex; // Ensure counters avoid race conditions
-sem_t driveway_sem; // Semaphore to control num of lizards on the driveway
+DebugLog &debugLog = *new DebugLog; // Buffered debug output (-d); never destroyed, see logger.h NN DS
+ClassGate drivewayGate(MAX_LIZARD_CROSSING); // Controls num of lizards on the driveway, per service class NN DS
+PipelinedDriveway driveway; // Cell by cell driveway, one lane per direction (-k) NN DS
+CatInspector inspector; // Sampling cats (-s) NN DS
+CrossingLog crossingLog; // Binary log of every crossing (-l) NN DS
+OccupancyMap occupancy; // Which lizards are on the driveway NN DS
+LoadGenerator loadGenerator; // Open-loop crossing requests (-g) NN DS
+BehaviorMix behaviorMix(MAX_LIZARD_SLEEP, MAX_LIZARD_EAT); // Behavior classes (-m) NN DS
+int worldSeconds = WORLDEND; // Seconds each world is simulated (-t) NN DS
+int numLizards = NUM_LIZARDS; // Lizards per world (-n) NN DS
+int numEmergency = 0; // Lizards with emergency service (-e) NN DS
+int numCats = NUM_CATS; // Cats per world (-c) NN DS
+int drivewayCapacity = MAX_LIZARD_CROSSING; // Lizards allowed on the driveway (cells with -k) NN DS
+int profiling = 0; // Sample lizard phases (--profile, needs PROFILE=1) NN DS
+WorldSweep worldSweep; // Results of a forked sweep of worlds (-f) NN DS
+ThreadLayout threadLayout; // Stack, affinity and scheduling of threads NN DS
+CrossingCounters numCrossing; // Both counts in one lock-free word, read together by the cats NN DS
 
 /**************************************************/
 /* Please leave these variables alone.  They are  */
@@ -75,8 +118,8 @@ sem_t driveway_sem; // Semaphore to control num of lizards on the driveway
 /* program.  They should only be used in the code */
 /* I have provided.                               */
 /**************************************************/
-int numCrossingSago2MonkeyGrass;
-int numCrossingMonkeyGrass2Sago;
+atomic<int> numCrossingSago2MonkeyGrass; // NN DS
+atomic<int> numCrossingMonkeyGrass2Sago; // NN DS
 int debug;
 int running;
 /**************************************************/
@@ -86,8 +129,9 @@ int running;
  * and goes back to sleep. If the cat sees enough lizards it "plays" with them.
  */
 class Cat {
-	int     _id;        // the Id of the cat
-	thread* _catThread; // the thread simulating the cat
+	int    _id;        // the Id of the cat
+	WorldThread _catThread; // the thread simulating the cat (owned by value) NN DS
+	Rng    _rng;       // the cat's own random numbers, for sampling times NN DS
 	
 	public:
 		Cat(int id);
@@ -97,6 +141,7 @@ class Cat {
     
   private:
 		void sleepNow();
+		void inspect(); // NN DS
     static void catThread (Cat *aCat); 
 };
 
@@ -107,6 +152,7 @@ class Cat {
  */
 Cat::Cat (int id) {
 	_id = id;
+  _rng.reseed(random()); // NN DS
 }
 
 /**
@@ -123,8 +169,9 @@ int Cat::getId() {
  */
 void Cat::run() {
   // NN DS
-  if(!_catThread) {
-    _catThread = new thread(catThread, this);
+  if(!_catThread.joinable() && !_catThread.start([this] { catThread(this); }, numLizards + _id, true)) {
+    cerr << "cannot start cat " << _id << endl;
+    exit(1);
   }
 }
 
@@ -133,8 +180,8 @@ void Cat::run() {
  */
 void Cat::wait() {
   // NN DS
-  if(_catThread && _catThread->joinable()) {
-    _catThread->join(); // Wait for the thread to terminate
+  if(_catThread.joinable()) {
+    _catThread.join(); // Wait for the thread to terminate
   }
 }
 
@@ -147,17 +194,13 @@ void Cat::sleepNow() {
 	sleepSeconds = 1 + (int)(random() / (double)RAND_MAX * MAX_CAT_SLEEP);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << _id << "] cat sleeping for " << sleepSeconds << " seconds" << endl;
-		cout << flush;
+    debugLog.line("[%d] cat sleeping for %d seconds", _id, sleepSeconds); // NN DS
   }
 
 	sleep(sleepSeconds);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << _id << "] cat awake" << endl;
-		cout << flush;
+    debugLog.line("[%d] cat awake", _id); // NN DS
   }
 }
 
@@ -169,34 +212,59 @@ void Cat::sleepNow() {
  */
 void Cat::catThread(Cat *aCat) {
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << aCat->getId() << "] cat is alive\n";
-		cout << flush;
+    debugLog.line("[%d] cat is alive", aCat->getId()); // NN DS
+  }
+
+  // Inspecting cats sample at their own rate and never abort NN DS
+  if(inspector.isOn()) {
+    aCat->inspect();
+    return;
   }
 
 	while(running) {
 		aCat->sleepNow();
 
 		// Check for too many lizards crossing
-    int totalCrossing = numCrossingSago2MonkeyGrass + numCrossingMonkeyGrass2Sago; // NN DS
-		if(totalCrossing > MAX_LIZARD_CROSSING) {
-      lock_guard<mutex> lock(cout_mutex); // NN DS
+    int totalCrossing = numCrossing.snapshot().total(); // NN DS
+		if(totalCrossing > drivewayCapacity) { // NN DS
+      PROFILED_LOCK_GUARD(lock, cout_mutex, PHASE_COUT_MUTEX); // NN DS
+		  debugLog.finalFlush(); // NN DS
 		  cout << "\tThe cats are happy - they have toys.\n";
+      cout << "\t" << occupancy.snapshot().describe() << endl; // NN DS
+      worldSweep.violation("The cats are happy - they have toys."); // NN DS
       exit(-1);
 		}
   }
 }
 
+/**
+ * Samples the crossing counters at the inspection rate until the world
+ * ends, then adds what the cat saw to the inspector's totals.
+ */
+void Cat::inspect() { // NN DS
+  InspectionWindow window(inspector.windowMicros());
+
+  while(running) {
+    sleepFor(inspector.nextInterval(_rng));
+    inspector.sample(window, numCrossing.snapshot(), drivewayCapacity, UNIDIRECTIONAL);
+  }
+  inspector.merge(window);
+}
+
 /**
  * This class models a lizard that sleeps, wakes-up, checks if it is safe to cross,
  * crosses over and eats, then checks if it is safe to return, and goes back to sleep.
  */
 class Lizard {
-	int     _id;      // the Id of the lizard
-	thread* _aLizard; // the thread simulating the lizard
+	int                  _id;        // the Id of the lizard
+	WorldThread          _aLizard;   // the thread simulating the lizard (owned by value) NN DS
+	uint64_t             _waitStart; // when the lizard started waiting at the gate NN DS
+	const BehaviorClass *_behavior;  // how the lizard sleeps, eats and crosses NN DS
+	Rng                  _rng;       // the lizard's own random numbers NN DS
+	Service              _service;   // service class at the driveway gate NN DS
 	
   public:
-		Lizard(int id);
+		Lizard(int id, const BehaviorClass *behavior); // NN DS
 		int getId();
     void run();
     void wait();
@@ -210,16 +278,23 @@ class Lizard {
 		void crossMonkeyGrass2Sago();
 		void madeIt2Sago();
 		void sleepNow();
+    void crossDriveway(uint32_t direction); // NN DS
+    void logCrossing(uint32_t direction, uint64_t enter); // NN DS
     static void lizardThread(Lizard *aLizard);
+    static void loadThread(Lizard *aLizard); // NN DS
 };
 
 /**
  * Constructs a lizard.
  *
- * @param id - the Id of the lizard 
+ * @param id       - the Id of the lizard 
+ * @param behavior - the behavior class the lizard belongs to
  */
-Lizard::Lizard(int id) {
+Lizard::Lizard(int id, const BehaviorClass *behavior) {
 	_id = id;
+  _behavior = behavior;  // NN DS
+  _rng.reseed(random()); // NN DS
+  _service = id < numEmergency ? EMERGENCY_SERVICE : NORMAL_SERVICE; // NN DS
 }
 
 /**
@@ -236,8 +311,10 @@ int Lizard::getId() {
  */
 void Lizard::run() {
   // NN DS
-  if(!_aLizard) {
-    _aLizard = new thread(lizardThread, this);
+  void (*body)(Lizard *) = loadGenerator.isOn() ? loadThread : lizardThread;
+  if(!_aLizard.joinable() && !_aLizard.start([this, body] { body(this); }, _id, false)) {
+    cerr << "cannot start lizard " << _id << endl;
+    exit(1);
   }
 }
  
@@ -246,8 +323,8 @@ void Lizard::run() {
  */
 void Lizard::wait() {
   // NN DS
-	if(_aLizard && _aLizard->joinable()) {
-    _aLizard->join(); // wait for the thread to terminate
+	if(_aLizard.joinable()) {
+    _aLizard.join(); // wait for the thread to terminate
   } 
 }
 
@@ -255,22 +332,20 @@ void Lizard::wait() {
  * Simulate a lizard sleeping for a random amount of time
  */
 void Lizard::sleepNow() {
-	int sleepSeconds;
+  PROFILE_PHASE(PHASE_SLEEP); // NN DS
+
+	double sleepSeconds;
 
-	sleepSeconds = 1 + (int)(random() / (double)RAND_MAX * MAX_LIZARD_SLEEP);
+	sleepSeconds = drawDuration(_behavior->sleep, _rng); // NN DS
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-    cout << "[" << _id << "] sleeping for " << sleepSeconds << " seconds" << endl;
-    cout << flush;
+    debugLog.line("[%d] sleeping for %g seconds", _id, sleepSeconds); // NN DS
   }
 
-	sleep(sleepSeconds);
+	sleepFor(sleepSeconds); // NN DS
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-    cout << "[" << _id << "] awake" << endl;
-    cout << flush;
+    debugLog.line("[%d] awake", _id); // NN DS
   }
 }
 
@@ -279,19 +354,24 @@ void Lizard::sleepNow() {
  * to the monkey grass.
  */
 void Lizard::sago2MonkeyGrassIsSafe() {
+  PROFILE_PHASE(PHASE_SAGO_SAFE); // NN DS
+
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << _id << "] checking sago -> monkey grass" << endl;
-		cout << flush;
+    debugLog.line("[%d] checking sago -> monkey grass", _id); // NN DS
   }
 
-  // Wait for a spot on the driveway
-  sem_wait(&driveway_sem); // NN DS
+  // Start the clock on the gate wait
+  _waitStart = monotonicMicros(); // NN DS
+
+  // Wait for room in this direction's lane (-k), then a spot on the driveway
+  { // NN DS
+    PROFILE_PHASE(PHASE_SEM_WAIT);
+    driveway.enterLane(0); // NN DS
+    drivewayGate.enter(_service); // NN DS
+  }
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << _id << "] thinks sago -> monkey grass is safe" << endl;
-		cout << flush;
+    debugLog.line("[%d] thinks sago -> monkey grass is safe", _id); // NN DS
   }
 }
 
@@ -300,54 +380,64 @@ void Lizard::sago2MonkeyGrassIsSafe() {
  * the monkey grass. 
  */
 void Lizard::crossSago2MonkeyGrass() {
+  PROFILE_PHASE(PHASE_CROSS_SAGO); // NN DS
+  uint64_t enter = monotonicMicros(); // stepped onto the driveway NN DS
+
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-    cout << "[" << _id << "] crossing  sago -> monkey grass" << endl;
-    cout << flush;
+    debugLog.line("[%d] crossing  sago -> monkey grass", _id); // NN DS
   }
 
-	// One more crossing this way
-	{ // NN DS
-    lock_guard<mutex> lock(crossing_mutex);
-    numCrossingSago2MonkeyGrass++;
+  // One more crossing this way. The pair is only read back when something
+  // looks at both directions, since the sharded counters pay for the read
+  int crossingThisWay = numCrossingSago2MonkeyGrass.fetch_add(1, memory_order_relaxed) + 1; // NN DS
+  CrossingSnapshot crossing = { 0, 0 }; // NN DS
+  if(UNIDIRECTIONAL) {
+    crossing = numCrossing.enterAndRead(0);
+  } else {
+    numCrossing.enter(0);
   }
+  occupancy.enter(0, (uint32_t)_id); // NN DS
 
   // NN DS
   if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << numCrossingSago2MonkeyGrass << " crossing sago -> monkey grass" << endl;
-    cout << flush;
+    debugLog.line("%d crossing sago -> monkey grass", crossingThisWay);
   }
 
 	// Check for lizards cross both ways
-	if(numCrossingMonkeyGrass2Sago && UNIDIRECTIONAL) {
+	if(crossing[1] && UNIDIRECTIONAL) { // NN DS
+		debugLog.finalFlush(); // NN DS
 		cout << "\tCrash!  We have a pile-up on the concrete." << endl;
-		cout << "\t" << numCrossingSago2MonkeyGrass << " crossing sago -> monkey grass" << endl;
-		cout << "\t" << numCrossingMonkeyGrass2Sago << " crossing monkey grass -> sago" << endl;
+		cout << "\t" << crossing.sago2MonkeyGrass << " crossing sago -> monkey grass" << endl;
+		cout << "\t" << crossing.monkeyGrass2Sago << " crossing monkey grass -> sago" << endl;
+		cout << "\t" << occupancy.snapshot().describe() << endl; // NN DS
+		worldSweep.violation("Crash!  We have a pile-up on the concrete."); // NN DS
 		exit(-1);
   }
 
 	// It takes a while to cross, so simulate it
-	sleep(CROSS_SECONDS);
+	crossDriveway(0); // NN DS
 
   // That one seems to have made it
-  { // NN DS
-    lock_guard<mutex> lock(crossing_mutex);
-    numCrossingSago2MonkeyGrass--;
-  }
+  occupancy.leave(0, (uint32_t)_id); // NN DS
+  numCrossing.leave(0); // NN DS
+  numCrossingSago2MonkeyGrass.fetch_sub(1, memory_order_relaxed); // NN DS
+
+  // Record the finished crossing
+  logCrossing(0, enter); // NN DS
 }
 
 /**
  * Tells others they can go now
  */
 void Lizard::madeIt2MonkeyGrass() {
+  PROFILE_PHASE(PHASE_MADE_IT_GRASS); // NN DS
+
 	// Whew, made it across, release spot
-  sem_post(&driveway_sem); // NN DS
+  drivewayGate.leave(_service); // NN DS
+  driveway.leaveLane(0); // NN DS
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << _id << "] made the sago -> monkey grass crossing" << endl;
-		cout << flush;
+    debugLog.line("[%d] made the sago -> monkey grass crossing", _id); // NN DS
   }
 }
 
@@ -355,23 +445,21 @@ void Lizard::madeIt2MonkeyGrass() {
  * Simulate a lizard eating for a random amount of time
  */
 void Lizard::eat() {
-	int eatSeconds;
+  PROFILE_PHASE(PHASE_EAT); // NN DS
+
+	double eatSeconds;
 
-	eatSeconds = 1 + (int)(random() / (double)RAND_MAX * MAX_LIZARD_EAT);
+	eatSeconds = drawDuration(_behavior->eat, _rng); // NN DS
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << _id << "] eating for " << eatSeconds << " seconds" << endl;
-		cout << flush;
+    debugLog.line("[%d] eating for %g seconds", _id, eatSeconds); // NN DS
   }
 
 	// Simulate eating by blocking for a few seconds
-	sleep(eatSeconds);
+	sleepFor(eatSeconds); // NN DS
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-    cout << "[" << _id << "] finished eating" << endl;
-    cout << flush;
+    debugLog.line("[%d] finished eating", _id); // NN DS
   }
 }
 
@@ -380,19 +468,24 @@ void Lizard::eat() {
  * grass to the sago.
  */
 void Lizard::monkeyGrass2SagoIsSafe() {
+  PROFILE_PHASE(PHASE_GRASS_SAFE); // NN DS
+
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << _id << "] checking monkey grass -> sago" << endl;
-		cout << flush;
+    debugLog.line("[%d] checking monkey grass -> sago", _id); // NN DS
   }
 
-  // Wait for a spot on the driveway
-  sem_wait(&driveway_sem); // NN DS
+  // Start the clock on the gate wait
+  _waitStart = monotonicMicros(); // NN DS
+
+  // Wait for room in this direction's lane (-k), then a spot on the driveway
+  { // NN DS
+    PROFILE_PHASE(PHASE_SEM_WAIT);
+    driveway.enterLane(1); // NN DS
+    drivewayGate.enter(_service); // NN DS
+  }
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << _id << "] thinks monkey grass -> sago is safe" << endl;
-		cout << flush;
+    debugLog.line("[%d] thinks monkey grass -> sago is safe", _id); // NN DS
   }
 }
 
@@ -401,55 +494,112 @@ void Lizard::monkeyGrass2SagoIsSafe() {
  * grass to the sago. 
  */
 void Lizard::crossMonkeyGrass2Sago() {
+  PROFILE_PHASE(PHASE_CROSS_GRASS); // NN DS
+  uint64_t enter = monotonicMicros(); // stepped onto the driveway NN DS
+
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << _id << "] crossing monkey grass -> sago" << endl;
-		cout << flush;
+    debugLog.line("[%d] crossing monkey grass -> sago", _id); // NN DS
   }
 
-  // One more crossing this way
-  { // NN DS
-    lock_guard<mutex> lock(crossing_mutex);
-	  numCrossingMonkeyGrass2Sago++;
+  // One more crossing this way. The pair is only read back when something
+  // looks at both directions, since the sharded counters pay for the read
+  int crossingThisWay = numCrossingMonkeyGrass2Sago.fetch_add(1, memory_order_relaxed) + 1; // NN DS
+  CrossingSnapshot crossing = { 0, 0 }; // NN DS
+  if(UNIDIRECTIONAL) {
+    crossing = numCrossing.enterAndRead(1);
+  } else {
+    numCrossing.enter(1);
   }
+  occupancy.enter(1, (uint32_t)_id); // NN DS
 
   // NN DS
   if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << numCrossingMonkeyGrass2Sago << " crossing monkey grass -> sago" << endl;
-    cout << flush;
+    debugLog.line("%d crossing monkey grass -> sago", crossingThisWay);
   }
   
   // Check for lizards cross both ways
-	if(numCrossingSago2MonkeyGrass && UNIDIRECTIONAL) {
+	if(crossing[0] && UNIDIRECTIONAL) { // NN DS
+		debugLog.finalFlush(); // NN DS
 		cout << "\tOh No!, the lizards have cats all over them." << endl;
-		cout << "\t " << numCrossingSago2MonkeyGrass << " crossing sago -> monkey grass" << endl;
-		cout << "\t " << numCrossingMonkeyGrass2Sago << " crossing monkey grass -> sago" << endl;
+		cout << "\t " << crossing.sago2MonkeyGrass << " crossing sago -> monkey grass" << endl;
+		cout << "\t " << crossing.monkeyGrass2Sago << " crossing monkey grass -> sago" << endl;
+		cout << "\t " << occupancy.snapshot().describe() << endl; // NN DS
+		worldSweep.violation("Oh No!, the lizards have cats all over them."); // NN DS
 		exit(-1);
   }
 
 	// It takes a while to cross, so simulate it
-	sleep(CROSS_SECONDS);
+	crossDriveway(1); // NN DS
 
-	// That one seems to have made it
-  { // NN DS
-    lock_guard<mutex> lock(crossing_mutex);
-	  numCrossingMonkeyGrass2Sago--;
-  }
+  // That one seems to have made it
+  occupancy.leave(1, (uint32_t)_id); // NN DS
+  numCrossing.leave(1); // NN DS
+  numCrossingMonkeyGrass2Sago.fetch_sub(1, memory_order_relaxed); // NN DS
+
+  // Record the finished crossing
+  logCrossing(1, enter); // NN DS
 }
 
 /**
  * Tells others they can go now
  */
 void Lizard::madeIt2Sago() {
+  PROFILE_PHASE(PHASE_MADE_IT_SAGO); // NN DS
+
   // Release a spot on the driveway
-  sem_post(&driveway_sem); // NN DS
+  drivewayGate.leave(_service); // NN DS
+  driveway.leaveLane(1); // NN DS
 
 	// Whew, made it across
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-		cout << "[" << _id << "] made the monkey grass -> sago crossing" << endl;
-		cout << flush;
+    debugLog.line("[%d] made the monkey grass -> sago crossing", _id); // NN DS
+  }
+}
+
+/**
+ * Spends the crossing time on the driveway: one sleep, or a walk across
+ * the cells of the pipelined driveway (-k). Meeting a lizard head-on in a
+ * cell is a pile-up.
+ *
+ * @param direction - 0 for sago to monkey grass, 1 for the way back
+ */
+void Lizard::crossDriveway(uint32_t direction) { // NN DS
+  double seconds = CROSS_SECONDS * _behavior->crossScale;
+  uint32_t conflict;
+
+  if(!driveway.isOn()) {
+    sleepFor(seconds);
+    return;
+  }
+  if(!driveway.cross((uint32_t)_id, direction, seconds, conflict)) {
+    debugLog.finalFlush(); // NN DS
+    cout << "\tCrash!  Lizards " << _id << " and " << PipelinedDriveway::lizardOf(conflict)
+         << " met head-on on the driveway." << endl;
+    worldSweep.violation("Crash!  Lizards met head-on in a driveway cell.");
+    exit(-1);
+  }
+}
+
+/**
+ * Counts one finished crossing towards the lizard's behavior class,
+ * service class and the current sweep world, and appends it to the
+ * crossing log, if logging is on.
+ *
+ * @param direction - 0 for sago to monkey grass, 1 for the way back
+ * @param enter     - monotonicMicros() when the lizard entered the driveway
+ */
+void Lizard::logCrossing(uint32_t direction, uint64_t enter) { // NN DS
+  uint64_t wait = enter - _waitStart;
+
+  behaviorMix.countCrossing(_behavior, wait);
+  drivewayGate.countWait(_service, wait);
+  worldSweep.crossing((uint32_t)_id, direction, enter, wait);
+  if(crossingLog.isOpen()) {
+    CrossingRecord crossing = {
+      (uint32_t)_id, direction, crossingLog.since(enter),
+      crossingLog.since(monotonicMicros()), wait
+    };
+    crossingLog.record(crossing);
   }
 }
 
@@ -462,9 +612,7 @@ void Lizard::madeIt2Sago() {
   */
 void Lizard::lizardThread(Lizard *aLizard) {
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex); // NN DS
-    cout << "[" << aLizard->getId() << "] lizard is alive" << endl;
-    cout << flush;
+    debugLog.line("[%d] lizard is alive", aLizard->getId()); // NN DS
   }
 
 	while(running) {
@@ -481,101 +629,317 @@ void Lizard::lizardThread(Lizard *aLizard) {
 }
 
 /**
- * main()
+ * Serves crossing requests of the load generator (-g) instead of
+ * sleeping and eating: waits for a request, crosses the way it asks
+ * and reports back, until the world ends.
  *
- * Should initialize variables, locks, semaphores, etc.
- * Should start the cat thread and the lizard threads.
- * Should block until all threads have terminated.
+ * @param aLizard - the lizard to be executed concurrently
  */
-int main(int argc, char **argv) {
-	// Declare local variables
-  vector<Lizard*> allLizards;
-  vector<Cat*>    allCats; // NN DS
-
-	// Check for the debugging flag (-d)
-	debug = 0;
-	if(argc > 1) {
-		if(strncmp(argv[1], "-d", 2) == 0) {
-			debug = 1;
+void Lizard::loadThread(Lizard *aLizard) { // NN DS
+  CrossingRequest request;
+
+  while(loadGenerator.take(request)) {
+    uint64_t entered;
+    if(request.direction == 0) {
+      aLizard->sago2MonkeyGrassIsSafe();
+      entered = monotonicMicros();
+      aLizard->crossSago2MonkeyGrass();
+      aLizard->madeIt2MonkeyGrass();
+    } else {
+      aLizard->monkeyGrass2SagoIsSafe();
+      entered = monotonicMicros();
+      aLizard->crossMonkeyGrass2Sago();
+      aLizard->madeIt2Sago();
     }
+    loadGenerator.completed(request, entered);
   }
+}
 
+/**
+ * Builds one lizard world out of the given pools, lets it run for
+ * worldSeconds and tears it down again.
+ *
+ * The pools are cleared rather than released, so after the first world
+ * they already hold enough capacity and rebuilding a world performs no
+ * further heap allocations.
+ *
+ * @param allLizards - contiguous storage for the lizards of this world
+ * @param allCats    - contiguous storage for the cats of this world
+ */
+void runWorld(vector<Lizard> &allLizards, vector<Cat> &allCats) { // NN DS
 	// Initialize variables
 	numCrossingSago2MonkeyGrass = 0;
 	numCrossingMonkeyGrass2Sago = 0;
+	numCrossing.reset(); // NN DS
+  occupancy.reset(numLizards); // NN DS
 	running = 1;
-
-	// Initialize random number generator
-	srandom((unsigned int)time(NULL));
+  if(debug) { // NN DS
+    debugLog.start();
+  }
 
 	// Initialize locks and/or semaphores
-  sem_init(&driveway_sem, 0, MAX_LIZARD_CROSSING); // NN DS
+  drivewayGate.reset(); // NN DS
+  driveway.clear(); // NN DS
+  threadLayout.prepare(numLizards + numCats); // NN DS
 
-	// Create NUM_LIZARDS lizard threads
-  for(int i = 0; i < NUM_LIZARDS; i++) {
-    allLizards.push_back(new Lizard(i));
+	// Create numLizards lizards in place. The threads keep a pointer to
+	// their lizard, so the pool must never grow once they are running.
+  allLizards.clear();
+  allLizards.reserve(numLizards); // NN DS
+  for(int i = 0; i < numLizards; i++) {
+    allLizards.emplace_back(i, behaviorMix.classFor(i, numLizards));
   }
 
-  // Create NUM_CATS cat threads
-  // NN DS
-	for(int i = 0; i < NUM_CATS; i++) {
-    allCats.push_back(new Cat(i));
+  // Create numCats cats in place
+	allCats.clear();
+  allCats.reserve(numCats); // NN DS
+	for(int i = 0; i < numCats; i++) {
+    allCats.emplace_back(i);
   }
 
-	// Run NUM_LIZARDS threads
-  for(int i = 0; i < NUM_LIZARDS; i++) {
-    allLizards[i]->run();
+	// Run numLizards threads
+  for(auto &lizard : allLizards) {
+    lizard.run();
   }
 
-  // Run NUM_CATS threads
-  // NN DS
-  for(int i = 0; i < NUM_CATS; i++) {
-    allCats[i]->run();
+  // Run numCats threads
+  for(auto &cat : allCats) {
+    cat.run();
   }
 
-	// Now let the world run for a while
-	sleep(WORLDEND);
+	// Now let the world run for a while, feeding it requests with -g
+  if(loadGenerator.isOn()) { // NN DS
+    loadGenerator.generate(worldSeconds);
+    loadGenerator.close();
+  } else {
+    sleep(worldSeconds);
+  }
+  threadLayout.sampleMemory(); // NN DS
 
   // That's it - the end of the world
 	running = 0;
 
   // Wait until all lizard threads terminate
-  // NN DS
-  for(int i = 0; i < NUM_LIZARDS; i++) {
-    allLizards[i]->wait();
+  for(auto &lizard : allLizards) {
+    lizard.wait();
   }
 
   // Wait until all cat threads terminate
-  // NN DS
-  for(int i = 0; i < NUM_CATS; i++) {
-    allCats[i]->wait();
+  for(auto &cat : allCats) {
+    cat.wait();
   }
+  debugLog.stop(); // NN DS
+}
 
-	// Delete all lizard objects
-  // NN DS
-  for(int i = 0; i < NUM_LIZARDS; i++) {
-    if(allLizards[i] != nullptr) {
-      delete allLizards[i];
+/**
+ * main()
+ *
+ * Should initialize variables, locks, semaphores, etc.
+ * Should start the cat thread and the lizard threads.
+ * Should block until all threads have terminated.
+ *
+ * Options:
+ *   -d     enable debugging output
+ *   -o P   what a thread does when its debug lines outrun the writer:
+ *          "block" (the default) waits, "drop" throws lines away,
+ *          "count" throws them away and later prints how many
+ *   -n N   put N lizards in each world instead of NUM_LIZARDS
+ *   -e N   give the first N lizards emergency service at the gate
+ *   -c N   put N cats in each world instead of NUM_CATS
+ *   -s R   have every cat sample the driveway R times per second and
+ *          report how often it is in violation instead of aborting
+ *   -k N   cut the driveway into N cells per direction that lizards
+ *          cross one at a time; the driveway then holds N lizards
+ *          each way
+ *   -r N   rebuild and run the world N times in this process
+ *   -f N   run the -r worlds in N forked workers; a crashing world
+ *          only ends its own worker and the sweep goes on
+ *   -t N   simulate each world for N seconds instead of WORLDEND
+ *   -l F   log every crossing to F (read it back with crosslogdump)
+ *   -m M   mix of lizard behavior classes, e.g. "uniform=80,bursty=20"
+ *   -g R   drive the gate open-loop: instead of sleeping and eating, the
+ *          lizards serve crossing requests arriving at R per second,
+ *          one world per rate, e.g. "poisson:0.5,1,2" or "constant:1";
+ *          "auto" (or "auto:R" to start at R) doubles the rate until
+ *          the gate leaves over a tenth of the requests unserved, then
+ *          narrows down where it saturates
+ *   -p, --profile
+ *          print a per-phase profile at shutdown (build with PROFILE=1)
+ *   --stack KB
+ *          give every lizard and cat thread a KB kilobyte stack
+ *   --affinity L
+ *          pin threads: "compact" onto neighboring CPUs, "scatter"
+ *          round robin across cores, "node" round robin over NUMA nodes
+ *   --fifo-cats
+ *          run the cats under SCHED_FIFO (needs CAP_SYS_NICE)
+ */
+int main(int argc, char **argv) {
+	// Declare local variables
+  vector<Lizard> allLizards; // NN DS
+  vector<Cat>    allCats;    // NN DS
+  int numWorlds = 1;         // NN DS
+  int numWorkers = 0;        // NN DS
+  int opt;                   // NN DS
+  static const struct option longOptions[] = { // NN DS
+    {"profile", no_argument, NULL, 'p'},
+    {"stack", required_argument, NULL, 'S'},
+    {"affinity", required_argument, NULL, 'A'},
+    {"fifo-cats", no_argument, NULL, 'F'},
+    {NULL, 0, NULL, 0}
+  };
+
+	// Check for the debugging flag (-d) and world options
+	debug = 0;
+  while((opt = getopt_long(argc, argv, "c:de:f:g:k:l:m:n:o:pr:s:t:", longOptions, NULL)) != -1) { // NN DS
+    switch(opt) {
+      case 'A':
+        if(!threadLayout.setAffinity(optarg)) {
+          cerr << "the affinity layout is compact, scatter or node" << endl;
+          return 1;
+        }
+        break;
+      case 'F': threadLayout.enableFifoCats(); break;
+      case 'S':
+        if(!threadLayout.setStack(optarg)) {
+          cerr << "the stack size is a number of kilobytes" << endl;
+          return 1;
+        }
+        break;
+      case 'c': numCats = atoi(optarg); break;
+      case 'd': debug = 1; break;
+      case 'e': numEmergency = atoi(optarg); break;
+      case 'f': numWorkers = atoi(optarg); break;
+      case 'g':
+        if(!loadGenerator.parse(optarg)) {
+          cerr << "bad load '" << optarg << "'; rates are [poisson:|constant:]rate,rate,... or [poisson:|constant:]auto[:rate]" << endl;
+          return 1;
+        }
+        break;
+      case 'k':
+        if(atoi(optarg) < 1 || atoi(optarg) > MAX_DRIVEWAY_CELLS) {
+          cerr << "the driveway needs 1 to " << MAX_DRIVEWAY_CELLS << " cells" << endl;
+          return 1;
+        }
+        driveway.configure(atoi(optarg), 2);
+        break;
+      case 'l':
+        if(!crossingLog.open(optarg)) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      case 'm':
+        if(!behaviorMix.parse(optarg)) {
+          cerr << "bad behavior mix '" << optarg << "'; classes are " BEHAVIOR_NAMES << endl;
+          return 1;
+        }
+        break;
+      case 'n': numLizards = atoi(optarg); break;
+      case 'o':
+        if(!debugLog.setOverflow(optarg)) {
+          cerr << "the overflow policy is block, drop or count" << endl;
+          return 1;
+        }
+        break;
+      case 'p': profiling = 1; break;
+      case 'r': numWorlds = atoi(optarg); break;
+      case 's': inspector.configure(atof(optarg)); break;
+      case 't': worldSeconds = atoi(optarg); break;
+      default:
+        cerr << "usage: " << argv[0] << " [-c cats] [-d] [-e emergency] [-f workers] [-g rates] [-k cells] [-l logfile] [-m mix]"
+             " [-n lizards] [-o overflow] [-p] [-r worlds] [-s rate] [-t seconds]"
+             " [--stack KB] [--affinity layout] [--fifo-cats]" << endl;
+        return 1;
     }
   }
 
-  // Delete all cat objects
-  // NN DS
-  for(int i = 0; i < NUM_CATS; i++) {
-    if(allCats[i] != nullptr) {
-      delete allCats[i];
-    }
+  // The profiler only exists when it was compiled in
+  if(profiling && !PROFILE) { // NN DS
+    cerr << "profiling is compiled out; rebuild with make PROFILE=1" << endl;
+    return 1;
   }
 
-  // Destroy the semaphore
-  sem_destroy(&driveway_sem); // NN DS
+  // The log writer and profiler live in one process; a sweep has many
+  if(numWorkers > 0 && (crossingLog.isOpen() || profiling)) { // NN DS
+    cerr << "-l and -p cannot be combined with -f" << endl;
+    return 1;
+  }
 
-  // Announce the end of the world
-  if(debug) { // NN DS
-    cout << "world ended" << endl;
-    cout << flush;
+  // A load sweep runs one world per rate itself
+  if(loadGenerator.isOn() && (numWorkers > 0 || numWorlds != 1)) { // NN DS
+    cerr << "-g cannot be combined with -f or -r" << endl;
+    return 1;
   }
- 
-	// Exit happily
-  return 0;
-}
\ No newline at end of file
+
+  // The sharded counters count up to 65535 lizards per direction
+  if(numLizards > CrossingCounters::MAX_LIZARDS) { // NN DS
+    cerr << "at most " << CrossingCounters::MAX_LIZARDS << " lizards with these counters" << endl;
+    return 1;
+  }
+
+  // A pipelined driveway holds one lizard per cell in each lane
+  if(driveway.isOn()) { // NN DS
+    drivewayCapacity = driveway.capacity();
+    drivewayGate.setCapacity(drivewayCapacity);
+  }
+
+  // Emergency spots are taken out of the driveway; normal lizards need one left
+  if(numEmergency > 0 && EMERGENCY_SPOTS >= drivewayCapacity) { // NN DS
+    cerr << "-e reserves " << EMERGENCY_SPOTS << " of the " << drivewayCapacity
+         << " driveway spots; normal lizards need at least one" << endl;
+    return 1;
+  }
+
+  // Normal lizards share the driveway; emergency ones get their own lane
+  drivewayGate.addClass("normal", 1, 0); // NN DS
+  if(numEmergency > 0) {
+    drivewayGate.addClass("emergency", EMERGENCY_WEIGHT, EMERGENCY_SPOTS);
+  }
+
+	// Initialize random number generator
+	srandom((unsigned int)time(NULL));
+
+  // Hand the worlds to forked workers and report what each one did
+  if(numWorkers > 0) { // NN DS
+    int crashed = worldSweep.run(numWorkers, numWorlds, (uint32_t)time(NULL),
+                                 [&] { runWorld(allLizards, allCats); });
+    return crashed == 0 ? 0 : 1;
+  }
+
+  // Run one world per offered rate of a load sweep
+  if(loadGenerator.isOn()) { // NN DS
+    numWorlds = (int)loadGenerator.numRates();
+  }
+
+  // Rebuild the world as many times as requested, reusing the pools
+  for(int world = 0; world < numWorlds; world++) { // NN DS
+    if(loadGenerator.isOn()) { // NN DS
+      loadGenerator.select(world);
+    }
+    runWorld(allLizards, allCats);
+    threadLayout.countWorld(behaviorMix.totalCrossings()); // NN DS
+    if(loadGenerator.isOn()) { // NN DS
+      loadGenerator.finishRate(worldSeconds);
+      numWorlds = (int)loadGenerator.numRates(); // An automatic sweep grows as it goes
+    }
+
+    // Announce the end of the world
+    if(debug) {
+      cout << "world ended" << endl;
+      cout << flush;
+    }
+  }
+
+  // Flush the crossing log and report per-class and per-phase results
+  bool logged = crossingLog.close(); // NN DS
+  behaviorMix.printSummary(); // NN DS
+  drivewayGate.printSummary(); // NN DS
+  inspector.printSummary(); // NN DS
+  loadGenerator.printCurve(numLizards); // NN DS
+  threadLayout.printSummary(numLizards + numCats); // NN DS
+  debugLog.printSummary(); // NN DS
+  PRINT_PROFILE(); // NN DS
+
+	// Exit happily, unless the crossing log is incomplete
+  return logged ? 0 : 1; // NN DS
+}
@@ -0,0 +1,667 @@
+/**
+ * File: lizardsCheck.cpp
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Exhaustive interleaving explorer for the driveway gates. The safety
+ * checks in the lizard programs (and the cats) only fire if the random
+ * timing happens to hit a bad interleaving. This program instead runs a
+ * model of the gate under a controlled scheduler and visits every
+ * reachable interleaving of a few lizards, checking after each step that
+ *
+ *   - no more than MAX_LIZARD_CROSSING lizards are on the driveway, and
+ *   - lizards never cross in both directions at once (uni gate, or -D),
+ *
+ * and that the lizards never deadlock. Sleeping and eating are local to
+ * a lizard, so they are not modeled; each lizard just crosses back and
+ * forth for a bounded number of trips.
+ *
+ * With -e the first lizards have emergency service, as in the programs:
+ * they may take the reserved spot of the driveway gate, and at the uni
+ * gates a lizard going the current way queues while one of them waits
+ * on the other side. Each queue's count of emergency waiters is kept the
+ * way lizardsUni.cpp keeps it and checked against the queue in every
+ * state.
+ *
+ * The search is a level-synchronous breadth-first search split across
+ * worker threads, so the first violation found comes with a shortest
+ * trace (shortest among the interleavings the reduction keeps). A lizard
+ * that was just admitted only moves itself onto the driveway in the
+ * model, so that step commutes with everything else, and when one is
+ * enabled it is the only step explored from that state (ample-set
+ * partial-order reduction).
+ *
+ * Gates:
+ *   uni     lizardsUni.cpp: driveway semaphore plus the direction gate with
+ *           per-direction queues and convoy admission (default)
+ *   biased  lizardsUni.cpp -b: the uni gate plus the direction bias, with
+ *           every load and store of the lock-free path as its own step
+ *           (the re-bias delay after a revocation only withholds a bias
+ *           and is not modeled)
+ *   bi      lizards.cpp: driveway semaphore only
+ *
+ * Usage:
+ *   lizardsCheck [-g uni|biased|bi] [-D] [-e emergency] [-n lizards] [-r trips] [-w workers]
+ */
+
+// C Includes
+#include <stdint.h> // For fixed width integers
+#include <stdio.h>  // For printf
+#include <stdlib.h> // For atoi
+#include <string.h> // For strcmp
+#include <unistd.h> // For getopt
+
+// C++ Includes
+#include <algorithm>     // For std::min
+#include <mutex>         // For the visited set shards
+#include <thread>        // For worker threads
+#include <unordered_map> // For the visited set
+#include <vector>        // For frontiers and traces
+
+// Usings
+using namespace std; // Cleans up code syntax a bit
+
+// Constants
+#define MAX_LIZARD_CROSSING   4 // Must match lizards.cpp and lizardsUni.cpp
+#define EMERGENCY_SPOTS       1 // Must match lizards.cpp and lizardsUni.cpp
+#define MAX_MODEL_LIZARDS     6 // Largest population the state encoding fits
+#define VISITED_SHARDS       64 // Independently locked parts of the visited set
+
+// Where a modeled lizard is in its trip
+enum Step {
+  AT_SEMAPHORE, // Waiting for a spot on the driveway (drivewayGate.enter)
+  AT_GATE,      // Holds a spot, asks the direction gate (enterDirection)
+  QUEUED,       // Parked in the direction queue until a flip admits it
+  ADMITTED,     // Counted as crossing; about to run the cross* checks
+  ON_DRIVEWAY,  // Crossing; next it leaves the direction (leaveDirection)
+  LEAVING,      // Off the driveway; next it releases its spot (drivewayGate.leave)
+  DONE,         // Finished all of its trips
+
+  // Biased gate only
+  SLOW_GATE,        // Takes direction_mutex in enterDirection
+  FAST_CLAIM,       // Saw its way favored; claims its bias slot
+  FAST_RECHECK,     // Holds its slot; checks the bias again
+  FAST_ENTER,       // Holds its slot; counts itself as crossing
+  FAST_ADMITTED,    // Like ADMITTED, through its slot
+  FAST_ON_DRIVEWAY, // Like ON_DRIVEWAY; next it counts itself off
+  FAST_RELEASE,     // Off the driveway; frees its slot
+  FAST_CHECK        // Checks whether the bias was revoked and it must flip
+};
+
+// Directions, matching lizardsUni.cpp minus NONE
+enum { SAGO_TO_GRASS = 0, GRASS_TO_SAGO = 1, NO_DIRECTION = 2 };
+
+static const char *const STEP_NAMES[] = {
+  "sem_wait", "enters the gate", "wakes up", "checks the driveway",
+  "leaves the driveway", "sem_post", "done", "takes direction_mutex",
+  "claims its bias slot", "rechecks the bias", "counts itself crossing",
+  "checks the driveway", "counts itself off", "frees its bias slot",
+  "checks for a revoked bias"
+};
+
+/**
+ * Complete state of the modeled world. Kept small and trivially
+ * copyable; pack() squeezes it into 128 bits for the visited set.
+ */
+struct State {
+  uint8_t step[MAX_MODEL_LIZARDS];   // Step of each lizard
+  uint8_t trip[MAX_MODEL_LIZARDS];   // Trips started; even = sago -> grass
+  uint8_t queue[2][MAX_MODEL_LIZARDS]; // Direction queues, in FIFO order
+  uint8_t queueLength[2];
+  uint8_t urgent[2];                 // Emergency lizards in each queue (GateQueue::urgent)
+  uint8_t crossing[2];               // numCrossing* counters
+  uint8_t direction;                 // currentDirection
+  uint8_t spots;                     // Free shared spots of drivewayGate
+  uint8_t urgentSpots;               // Spots emergency lizards hold on drivewayGate
+  uint8_t bias;                      // Favored direction of the biased gate
+};
+
+// 128-bit packed state used as the visited-set key
+struct Key {
+  uint64_t low, high;
+  bool operator==(const Key &other) const { return low == other.low && high == other.high; }
+};
+
+struct KeyHash {
+  size_t operator()(const Key &key) const {
+    uint64_t h = key.low * 0x9e3779b97f4a7c15ull ^ (key.high + 0x632be59bd9b4e019ull);
+    return (size_t)(h ^ (h >> 29));
+  }
+};
+
+// How a state was first reached, for rebuilding traces
+struct Parent {
+  Key     from;
+  int8_t  lizard; // Lizard that moved, -1 for the initial state
+};
+
+// Checker configuration
+int  numLizards = 3;      // Lizards in the model (-n)
+int  numTrips = 2;        // Crossings per lizard (-r)
+int  numUrgent = 0;       // Lizards with emergency service, the first ones (-e)
+bool uniGate = true;      // Model lizardsUni.cpp rather than lizards.cpp (-g)
+bool biasedGate = false;  // Add the direction bias of lizardsUni.cpp -b (-g)
+bool checkDirection = true; // Flag lizards crossing both ways (always for uni, -D for bi)
+
+/**
+ * Packs a state into a Key. Per lizard: 4 bits step, 3 bits trip; per
+ * queue: 3 bits length, 3 bits emergency count and 3 bits per entry;
+ * then the shared variables. Six lizards take at most 94 bits.
+ */
+Key pack(const State &s) {
+  unsigned __int128 bits = 0;
+  int shift = 0;
+  auto put = [&](uint64_t value, int width) {
+    bits |= (unsigned __int128)value << shift;
+    shift += width;
+  };
+
+  for(int i = 0; i < numLizards; i++) {
+    put(s.step[i], 4);
+    put(s.trip[i], 3);
+  }
+  for(int d = 0; d < 2; d++) {
+    put(s.queueLength[d], 3);
+    put(s.urgent[d], 3);
+    for(int i = 0; i < s.queueLength[d]; i++) {
+      put(s.queue[d][i], 3);
+    }
+  }
+  put(s.crossing[0], 3);
+  put(s.crossing[1], 3);
+  put(s.direction, 2);
+  put(s.spots, 3);
+  put(s.urgentSpots, 3);
+  put(s.bias, 2);
+
+  Key key = { (uint64_t)bits, (uint64_t)(bits >> 64) };
+  return key;
+}
+
+/**
+ * Returns the direction a lizard is crossing on its current trip.
+ */
+int tripDirection(const State &s, int lizard) {
+  return s.trip[lizard] % 2;
+}
+
+/**
+ * Returns true if the lizard has emergency service.
+ */
+bool isUrgent(int lizard) {
+  return lizard < numUrgent;
+}
+
+/**
+ * Returns how many emergency lizards are in the queue of direction d.
+ */
+int urgentQueued(const State &s, int d) {
+  int count = 0;
+  for(int i = 0; i < s.queueLength[d]; i++) {
+    count += isUrgent(s.queue[d][i]);
+  }
+  return count;
+}
+
+/**
+ * Returns true if the lizard's next step only touches its own state and
+ * therefore commutes with every other lizard's steps. A queued lizard
+ * is moved to ADMITTED by the flip itself, so its wake-up and its look
+ * at the driveway both collapse into this one local step.
+ *
+ * In the programs that look (the cross* checks) reads the shared
+ * counters, but the model does not need the read: violation() checks
+ * the counters in every state the search reaches, which covers every
+ * value the look could see. What is left of the step writes only the
+ * lizard's own step, which violation() and the other lizards never
+ * read, so it is independent of every other step and invisible to the
+ * invariants. Trips are bounded, so the reduction cannot postpone the
+ * other lizards forever.
+ */
+bool isLocalStep(const State &s, int lizard) {
+  return s.step[lizard] == ADMITTED || s.step[lizard] == FAST_ADMITTED;
+}
+
+/**
+ * Returns true if the lizard holds its bias slot.
+ */
+bool holdsSlot(const State &s, int lizard) {
+  return s.step[lizard] >= FAST_RECHECK && s.step[lizard] <= FAST_RELEASE;
+}
+
+/**
+ * Flips the gate if nobody is crossing in direction d any more
+ * (flipIfEmpty). Called with direction_mutex held.
+ */
+void flipIfEmpty(State &s, int d) {
+  if(s.direction != d || s.bias != NO_DIRECTION || s.crossing[d] > 0) {
+    return;
+  }
+  for(int i = 0; i < numLizards; i++) {
+    if(holdsSlot(s, i)) {
+      return;
+    }
+  }
+
+  int next = 1 - d;
+  if(s.queueLength[next] == 0) {
+    next = d;
+  }
+  if(s.queueLength[next] == 0) {
+    s.direction = NO_DIRECTION;
+    return;
+  }
+
+  int admitted = min((int)s.queueLength[next], MAX_LIZARD_CROSSING);
+  s.direction = (uint8_t)next;
+  for(int i = 0; i < admitted; i++) {
+    s.step[s.queue[next][i]] = ADMITTED;
+    s.crossing[next]++;
+    s.urgent[next] -= isUrgent(s.queue[next][i]);
+  }
+  s.queueLength[next] -= (uint8_t)admitted;
+  memmove(s.queue[next], s.queue[next] + admitted, s.queueLength[next]);
+}
+
+/**
+ * The part of enterDirection under direction_mutex: walk on, or queue
+ * up (revoking the bias, and flipping if the driveway is already empty).
+ * Going the current way only walks on while no emergency lizard waits
+ * on the other side.
+ */
+void enterUnderMutex(State &s, int lizard, int d) {
+  if(!uniGate || s.direction == NO_DIRECTION ||
+     (s.direction == d && s.urgent[1 - d] == 0)) {
+    s.direction = uniGate ? d : s.direction;
+    s.crossing[d]++;
+    s.step[lizard] = ADMITTED;
+    if(biasedGate && s.queueLength[1 - d] == 0 && s.bias == NO_DIRECTION) {
+      s.bias = (uint8_t)d;
+    }
+    return;
+  }
+
+  s.queue[d][s.queueLength[d]++] = (uint8_t)lizard;
+  s.urgent[d] += isUrgent(lizard);
+  s.step[lizard] = QUEUED;
+  if(biasedGate) {
+    s.bias = NO_DIRECTION;
+    flipIfEmpty(s, s.direction);
+  }
+}
+
+/**
+ * Takes a driveway spot for the lizard if its class has one
+ * (ClassGate::canAdmit and admit): an emergency lizard uses a reserved
+ * spot while one is left, everyone else a shared one. Waiting lizards
+ * may take spots in any order, which covers the gate's weighted order.
+ *
+ * @return false if the lizard has to wait.
+ */
+bool takeSpot(State &s, int lizard) {
+  bool reserved = isUrgent(lizard) && s.urgentSpots < EMERGENCY_SPOTS;
+  if(!reserved && s.spots == 0) {
+    return false;
+  }
+  if(!reserved) {
+    s.spots--;
+  }
+  s.urgentSpots += isUrgent(lizard);
+  return true;
+}
+
+/**
+ * Frees the lizard's driveway spot (ClassGate::leave).
+ */
+void freeSpot(State &s, int lizard) {
+  if(!isUrgent(lizard)) {
+    s.spots++;
+  } else if(--s.urgentSpots >= EMERGENCY_SPOTS) {
+    s.spots++;
+  }
+}
+
+/**
+ * Tries to take the next step of a lizard.
+ *
+ * @return false if the lizard is blocked or done.
+ */
+bool takeStep(State &s, int lizard) {
+  int d = tripDirection(s, lizard);
+
+  switch(s.step[lizard]) {
+    case AT_SEMAPHORE:
+      if(!takeSpot(s, lizard)) {
+        return false;
+      }
+      s.step[lizard] = AT_GATE;
+      return true;
+
+    case AT_GATE:
+      if(biasedGate) {
+        s.step[lizard] = s.bias == d ? FAST_CLAIM : SLOW_GATE;
+      } else {
+        enterUnderMutex(s, lizard, d);
+      }
+      return true;
+
+    case SLOW_GATE:
+      enterUnderMutex(s, lizard, d);
+      return true;
+
+    case FAST_CLAIM:
+      // Slots are picked by lizard id, so a modeled lizard's is always free
+      s.step[lizard] = FAST_RECHECK;
+      return true;
+
+    case FAST_RECHECK:
+      s.step[lizard] = s.bias == d ? FAST_ENTER : SLOW_GATE;
+      return true;
+
+    case FAST_ENTER:
+      s.crossing[d]++;
+      s.step[lizard] = FAST_ADMITTED;
+      return true;
+
+    case FAST_ADMITTED:
+      s.step[lizard] = FAST_ON_DRIVEWAY;
+      return true;
+
+    case FAST_ON_DRIVEWAY:
+      s.crossing[d]--;
+      s.step[lizard] = FAST_RELEASE;
+      return true;
+
+    case FAST_RELEASE:
+      s.step[lizard] = FAST_CHECK;
+      return true;
+
+    case FAST_CHECK:
+      s.step[lizard] = LEAVING;
+      if(s.bias != d) {
+        flipIfEmpty(s, d);
+      }
+      return true;
+
+    case QUEUED:
+      // Blocked on its semaphore; the flip moves it straight to ADMITTED
+      return false;
+
+    case ADMITTED:
+      s.step[lizard] = ON_DRIVEWAY;
+      return true;
+
+    case ON_DRIVEWAY:
+      s.step[lizard] = LEAVING;
+      if(--s.crossing[d] > 0 || !uniGate) {
+        return true;
+      }
+
+      // Last one out flips the gate, admitting a convoy (leaveDirection)
+      flipIfEmpty(s, d);
+      return true;
+
+    case LEAVING:
+      freeSpot(s, lizard);
+      s.trip[lizard]++;
+      s.step[lizard] = s.trip[lizard] < numTrips ? AT_SEMAPHORE : DONE;
+      return true;
+
+    case DONE:
+      return false;
+  }
+  return false;
+}
+
+/**
+ * Returns a description of the first invariant the state breaks, or
+ * NULL if it is safe.
+ */
+const char *violation(const State &s) {
+  if(s.crossing[0] + s.crossing[1] > MAX_LIZARD_CROSSING) {
+    return "too many lizards on the driveway (the cats are happy)";
+  }
+  if(checkDirection && s.crossing[0] > 0 && s.crossing[1] > 0) {
+    return "lizards crossing in both directions (pile-up on the concrete)";
+  }
+  if(s.urgent[0] != urgentQueued(s, 0) || s.urgent[1] != urgentQueued(s, 1)) {
+    return "emergency count out of step with its queue";
+  }
+  return NULL;
+}
+
+/**
+ * One shard of the visited set.
+ */
+struct VisitedShard {
+  mutex                              lock;
+  unordered_map<Key, Parent, KeyHash> parents;
+};
+
+VisitedShard visited[VISITED_SHARDS];
+
+/**
+ * Records key as reached from parent. Returns false if it was already
+ * visited.
+ */
+bool visit(const Key &key, const Parent &parent) {
+  VisitedShard &shard = visited[KeyHash()(key) % VISITED_SHARDS];
+  lock_guard<mutex> lock(shard.lock);
+  return shard.parents.insert(make_pair(key, parent)).second;
+}
+
+/**
+ * Looks up how key was reached.
+ */
+Parent parentOf(const Key &key) {
+  VisitedShard &shard = visited[KeyHash()(key) % VISITED_SHARDS];
+  lock_guard<mutex> lock(shard.lock);
+  return shard.parents.at(key);
+}
+
+// Something a worker found while expanding its part of a level
+struct Finding {
+  const char *problem;  // Invariant broken, or "deadlock"
+  Key         key;      // State in which it was found
+  State       state;
+};
+
+/**
+ * Expands states [begin, end) of the frontier into next. Successors
+ * that break an invariant and deadlocked states are added to findings.
+ */
+void expand(const vector<State> &frontier, size_t begin, size_t end,
+            vector<State> &next, vector<Finding> &findings, uint64_t &edges) {
+  for(size_t index = begin; index < end; index++) {
+    const State &state = frontier[index];
+    Key key = pack(state);
+
+    // Ample set: a single local step if there is one, otherwise every step
+    int only = -1;
+    for(int i = 0; i < numLizards && only < 0; i++) {
+      if(isLocalStep(state, i)) {
+        only = i;
+      }
+    }
+
+    bool moved = false, finished = true;
+    for(int i = 0; i < numLizards; i++) {
+      finished = finished && state.step[i] == DONE;
+      if(only >= 0 && i != only) {
+        continue;
+      }
+
+      State successor = state;
+      if(!takeStep(successor, i)) {
+        continue;
+      }
+      moved = true;
+      edges++;
+
+      Key successorKey = pack(successor);
+      Parent parent = { key, (int8_t)i };
+      if(!visit(successorKey, parent)) {
+        continue;
+      }
+
+      const char *problem = violation(successor);
+      if(problem) {
+        Finding finding = { problem, successorKey, successor };
+        findings.push_back(finding);
+      } else {
+        next.push_back(successor);
+      }
+    }
+
+    if(!moved && !finished) {
+      Finding finding = { "deadlock: no lizard can move", key, state };
+      findings.push_back(finding);
+    }
+  }
+}
+
+/**
+ * Prints one state on a single line.
+ */
+void printState(const State &s) {
+  static const char *const directionNames[] = { "sago->grass", "grass->sago", "none" };
+  printf("      spots=%d direction=%s crossing=%d/%d", s.spots,
+         directionNames[s.direction], s.crossing[0], s.crossing[1]);
+  if(numUrgent > 0) {
+    printf(" reserved=%d urgent=%d/%d", max(EMERGENCY_SPOTS - s.urgentSpots, 0),
+           s.urgent[0], s.urgent[1]);
+  }
+  if(biasedGate) {
+    printf(" bias=%s", directionNames[s.bias]);
+  }
+  printf(" |");
+  for(int i = 0; i < numLizards; i++) {
+    printf(" [%d%s] %s", i, isUrgent(i) ? "!" : "", STEP_NAMES[s.step[i]]);
+  }
+  printf("\n");
+}
+
+/**
+ * Rebuilds and prints the shortest trace that leads to a finding by
+ * following parent links back to the initial state and replaying them.
+ */
+void printTrace(const Finding &finding, const State &initial) {
+  vector<int> moves;
+  Key key = finding.key;
+  for(Parent parent = parentOf(key); parent.lizard >= 0; parent = parentOf(key)) {
+    moves.push_back(parent.lizard);
+    key = parent.from;
+  }
+  reverse(moves.begin(), moves.end());
+
+  printf("VIOLATION: %s\n", finding.problem);
+  printf("shortest trace (%zu steps):\n", moves.size());
+  State state = initial;
+  printState(state);
+  for(size_t i = 0; i < moves.size(); i++) {
+    int lizard = moves[i];
+    const char *action = STEP_NAMES[state.step[lizard]];
+    int d = tripDirection(state, lizard);
+    takeStep(state, lizard);
+    printf("  %2zu. [%d%s] %s (%s)\n", i + 1, lizard, isUrgent(lizard) ? "!" : "", action,
+           d == SAGO_TO_GRASS ? "sago -> monkey grass" : "monkey grass -> sago");
+    printState(state);
+  }
+}
+
+/**
+ * Parses options, explores the state space level by level and reports
+ * the first violation (with a shortest trace) or the size of the space.
+ */
+int main(int argc, char **argv) {
+  int numWorkers = (int)thread::hardware_concurrency();
+  bool forceDirection = false;
+  int opt;
+
+  while((opt = getopt(argc, argv, "De:g:n:r:w:")) != -1) {
+    switch(opt) {
+      case 'D': forceDirection = true; break;
+      case 'e': numUrgent = atoi(optarg); break;
+      case 'g':
+        uniGate = strcmp(optarg, "bi") != 0;
+        biasedGate = strcmp(optarg, "biased") == 0;
+        break;
+      case 'n': numLizards = atoi(optarg); break;
+      case 'r': numTrips = atoi(optarg); break;
+      case 'w': numWorkers = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-g uni|biased|bi] [-D] [-e emergency] [-n lizards] [-r trips]"
+                " [-w workers]\n", argv[0]);
+        return 2;
+    }
+  }
+  if(numLizards < 1 || numLizards > MAX_MODEL_LIZARDS || numTrips < 1 || numTrips > 7) {
+    fprintf(stderr, "%s: need 1-%d lizards and 1-7 trips\n", argv[0], MAX_MODEL_LIZARDS);
+    return 2;
+  }
+  if(numUrgent < 0 || numUrgent > numLizards) {
+    fprintf(stderr, "%s: need 0-%d emergency lizards\n", argv[0], numLizards);
+    return 2;
+  }
+  numWorkers = max(numWorkers, 1);
+  checkDirection = uniGate || forceDirection;
+
+  // Everybody starts at the sago, waiting for a spot
+  State initial;
+  memset(&initial, 0, sizeof(initial));
+  for(int i = 0; i < numLizards; i++) {
+    initial.step[i] = AT_SEMAPHORE;
+  }
+  initial.direction = NO_DIRECTION;
+  initial.spots = MAX_LIZARD_CROSSING - (numUrgent > 0 ? EMERGENCY_SPOTS : 0);
+  initial.bias = NO_DIRECTION;
+  Parent root = { pack(initial), -1 };
+  visit(root.from, root);
+
+  vector<State> frontier(1, initial);
+  uint64_t states = 1, edges = 0;
+  int depth = 0;
+
+  while(!frontier.empty()) {
+    vector<vector<State> >   next(numWorkers);
+    vector<vector<Finding> > findings(numWorkers);
+    vector<uint64_t>         workerEdges(numWorkers, 0);
+    vector<thread>           workers;
+
+    // Split the level between the workers
+    size_t chunk = (frontier.size() + numWorkers - 1) / numWorkers;
+    for(int w = 0; w < numWorkers; w++) {
+      size_t begin = min(frontier.size(), w * chunk);
+      size_t end = min(frontier.size(), begin + chunk);
+      workers.push_back(thread(expand, cref(frontier), begin, end, ref(next[w]),
+                               ref(findings[w]), ref(workerEdges[w])));
+    }
+    for(thread &worker : workers) {
+      worker.join();
+    }
+
+    // Any finding on this level comes with a shortest trace
+    for(int w = 0; w < numWorkers; w++) {
+      edges += workerEdges[w];
+      if(!findings[w].empty()) {
+        printTrace(findings[w][0], initial);
+        return 1;
+      }
+    }
+
+    frontier.clear();
+    for(int w = 0; w < numWorkers; w++) {
+      states += next[w].size();
+      frontier.insert(frontier.end(), next[w].begin(), next[w].end());
+    }
+    depth++;
+  }
+
+  printf("%s gate, %d lizards (%d emergency) x %d trips: no violations in %llu states, "
+         "%llu transitions, depth %d (%d workers)\n",
+         biasedGate ? "biased" : uniGate ? "uni" : "bi",
+         numLizards, numUrgent, numTrips, (unsigned long long)states,
+         (unsigned long long)edges, depth, numWorkers);
+  return 0;
+}
@@ -0,0 +1,362 @@
+/**
+ * File: lizardsCompare.cpp
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Regression gate for the lizard programs. Compares crossing logs
+ * ("lizards -l <file>" or "lizardsUni -l <file>") of a baseline build
+ * against logs of a candidate build and exits non-zero if the candidate
+ * is significantly slower.
+ *
+ * Every log is one trial. For each trial the tool measures throughput
+ * (crossings per second), the mean time spent on the driveway and the
+ * p50, p90 and p99 gate waits. The delta of each metric is the relative
+ * change of its mean over the candidate trials against its mean over
+ * the baseline trials. A percentile bootstrap, resampling the trials of
+ * both sides with replacement, gives a confidence interval for every
+ * delta. A metric regresses when its whole interval lies on the bad side
+ * of the tolerance, e.g. throughput at least 5% lower or a wait
+ * percentile at least 5% higher with 95% confidence.
+ *
+ * With a single log on either side, every log is cut into SLICES_PER_LOG
+ * equal stretches of time which serve as trials instead, so both sides
+ * still measure their percentiles over the same kind of trial.
+ *
+ * Usage:
+ *   lizardsCompare [-c confidence] [-n resamples] [-t tolerance]
+ *                  -b baseline.log [-b baseline.log ...] candidate.log ...
+ *
+ * Exit status: 0 if nothing regressed, 1 on a regression, 2 on bad usage
+ * or unreadable logs.
+ */
+
+// C Includes
+#include <fcntl.h>    // For open
+#include <getopt.h>   // For command-line options
+#include <stdio.h>    // For printf
+#include <stdlib.h>   // For atof
+#include <string.h>   // For memcpy
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For fstat
+#include <unistd.h>   // For close
+
+// C++ Includes
+#include <algorithm> // For sorting and nth_element
+#include <vector>    // For trials and samples
+
+// Project Includes
+#include "behavior.h" // For Rng
+#include "crosslog.h" // For the log format
+
+// Usings
+using namespace std; // Cleans up code syntax a bit
+
+// Constants
+#define DEFAULT_RESAMPLES 2000 // Bootstrap resamples per metric
+#define DEFAULT_CONFIDENCE  95 // Confidence of the intervals, in percent
+#define DEFAULT_TOLERANCE    5 // Change in percent a regression must exceed
+#define SLICES_PER_LOG      10 // Trials cut out of every log if a side has a single log
+#define BOOTSTRAP_SEED      42 // Fixed, so a comparison always gives the same answer
+
+// Classes/Enums
+
+// Metrics measured per trial
+enum Metric {
+  METRIC_THROUGHPUT, // Crossings per second
+  METRIC_CROSSING,   // Mean time on the driveway
+  METRIC_WAIT_P50,   // Gate wait percentiles
+  METRIC_WAIT_P90,
+  METRIC_WAIT_P99,
+  NUM_METRICS
+};
+
+static const char *const METRIC_NAMES[NUM_METRICS] = {
+  "throughput /s", "crossing ms", "wait p50 ms", "wait p90 ms", "wait p99 ms"
+};
+
+// Which way is better for each metric
+static const bool HIGHER_IS_BETTER[NUM_METRICS] = { true, false, false, false, false };
+
+// Printed values are scaled from the measured ones (per second, microseconds)
+static const double METRIC_SCALE[NUM_METRICS] = { 1, 1e-3, 1e-3, 1e-3, 1e-3 };
+
+// One trial: every metric measured on one log (or one slice of a log)
+struct Trial {
+  double value[NUM_METRICS];
+};
+
+// Global Variables
+int resamples = DEFAULT_RESAMPLES;     // Bootstrap resamples (-n)
+double confidence = DEFAULT_CONFIDENCE; // Confidence in percent (-c)
+double tolerance = DEFAULT_TOLERANCE;   // Regression threshold in percent (-t)
+
+// Log Functions
+
+/**
+ * Maps a crossing log and decodes every crossing in it.
+ *
+ * @param records - Filled with the crossings, in log order.
+ * @return false if the file is missing, not a crossing log, corrupt or truncated.
+ */
+bool readLog(const char *path, vector<CrossingRecord> &records) {
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    perror(path);
+    return false;
+  }
+  struct stat info;
+  if(fstat(fd, &info) < 0) {
+    perror(path);
+    close(fd);
+    return false;
+  }
+  size_t size = (size_t)info.st_size;
+  const uint8_t *data = size ? (const uint8_t *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                             : (const uint8_t *)MAP_FAILED;
+  close(fd);
+  if(data == MAP_FAILED) {
+    fprintf(stderr, "%s: not a crossing log\n", path);
+    return false;
+  }
+
+  const CrossLogFileHeader *header = (const CrossLogFileHeader *)data;
+  bool valid = size >= sizeof(*header) && header->magic == CROSSLOG_MAGIC &&
+               header->version == CROSSLOG_VERSION;
+
+  // Walk the blocks
+  vector<uint8_t>        columns;
+  vector<CrossingRecord> block;
+  size_t offset = sizeof(*header);
+  while(valid && offset + sizeof(CrossLogBlockHeader) <= size) {
+    // Blocks follow each other unaligned, so copy the header out
+    CrossLogBlockHeader blockHeader;
+    memcpy(&blockHeader, data + offset, sizeof(blockHeader));
+    offset += sizeof(blockHeader);
+    columns.resize(blockHeader.rawBytes);
+    uLongf rawBytes = blockHeader.rawBytes;
+    valid = offset + blockHeader.compressedBytes <= size &&
+            uncompress(columns.data(), &rawBytes, data + offset,
+                       blockHeader.compressedBytes) == Z_OK &&
+            decodeCrossingColumns(columns.data(), rawBytes, blockHeader.records,
+                                  blockHeader.firstEnter, block);
+    offset += blockHeader.compressedBytes;
+    records.insert(records.end(), block.begin(), block.end());
+  }
+
+  // Bytes left over that cannot hold a block header mean the log was cut short
+  valid = valid && offset == size;
+
+  munmap((void *)data, size);
+  if(!valid) {
+    fprintf(stderr, "%s: not a crossing log, or corrupt or truncated\n", path);
+  }
+  return valid;
+}
+
+/**
+ * Returns the value below which the given fraction of the samples lie.
+ * Reorders the samples.
+ */
+double percentile(vector<uint64_t> &samples, double fraction) {
+  size_t rank = min(samples.size() - 1, (size_t)(fraction * samples.size()));
+  nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return (double)samples[rank];
+}
+
+/**
+ * Measures one trial from the crossings that entered in [from, to).
+ *
+ * @return false if no crossing falls in the range.
+ */
+bool measure(const vector<CrossingRecord> &records, uint64_t from, uint64_t to, Trial &trial) {
+  vector<uint64_t> waits;
+  uint64_t firstEnter = UINT64_MAX, lastExit = 0, onDriveway = 0;
+
+  for(const CrossingRecord &r : records) {
+    if(r.enter < from || r.enter >= to) {
+      continue;
+    }
+    waits.push_back(r.wait);
+    onDriveway += r.exit - r.enter;
+    firstEnter = min(firstEnter, r.enter);
+    lastExit = max(lastExit, r.exit);
+  }
+  if(waits.empty()) {
+    return false;
+  }
+
+  double span = (lastExit - firstEnter) / 1e6;
+  trial.value[METRIC_THROUGHPUT] = span > 0 ? waits.size() / span : 0.0;
+  trial.value[METRIC_CROSSING] = (double)onDriveway / waits.size();
+  trial.value[METRIC_WAIT_P50] = percentile(waits, 0.50);
+  trial.value[METRIC_WAIT_P90] = percentile(waits, 0.90);
+  trial.value[METRIC_WAIT_P99] = percentile(waits, 0.99);
+  return true;
+}
+
+/**
+ * Turns the logs of one side into trials.
+ *
+ * @param slices - Trials to cut out of every log.
+ * @return false if a log could not be read or holds no crossings.
+ */
+bool loadSide(const vector<const char *> &paths, int slices, vector<Trial> &trials) {
+  for(const char *path : paths) {
+    vector<CrossingRecord> records;
+    if(!readLog(path, records)) {
+      return false;
+    }
+    if(records.empty()) {
+      fprintf(stderr, "%s: no crossings\n", path);
+      return false;
+    }
+
+    uint64_t first = UINT64_MAX, last = 0;
+    for(const CrossingRecord &r : records) {
+      first = min(first, r.enter);
+      last = max(last, r.enter);
+    }
+    uint64_t width = (last - first) / slices + 1;
+    for(int s = 0; s < slices; s++) {
+      Trial trial;
+      if(measure(records, first + s * width, first + (s + 1) * width, trial)) {
+        trials.push_back(trial);
+      }
+    }
+  }
+  return true;
+}
+
+// Statistics Functions
+
+/**
+ * Mean of one metric over the trials picked by index.
+ */
+double meanOf(const vector<Trial> &trials, const vector<size_t> &picked, int metric) {
+  double sum = 0;
+  for(size_t i : picked) {
+    sum += trials[i].value[metric];
+  }
+  return sum / picked.size();
+}
+
+/**
+ * Relative change from base to candidate in percent.
+ */
+double deltaOf(double base, double candidate) {
+  return base != 0 ? 100.0 * (candidate - base) / base : 0.0;
+}
+
+/**
+ * Bootstraps a confidence interval for the delta of one metric.
+ *
+ * @param low, high - Set to the bounds of the interval, in percent.
+ */
+void bootstrap(const vector<Trial> &base, const vector<Trial> &candidate, int metric,
+               Rng &rng, double &low, double &high) {
+  vector<double> deltas(resamples);
+  vector<size_t> pickedBase(base.size()), pickedCandidate(candidate.size());
+
+  for(int r = 0; r < resamples; r++) {
+    for(size_t &i : pickedBase) {
+      i = (size_t)(rng.uniform() * base.size());
+    }
+    for(size_t &i : pickedCandidate) {
+      i = (size_t)(rng.uniform() * candidate.size());
+    }
+    deltas[r] = deltaOf(meanOf(base, pickedBase, metric),
+                        meanOf(candidate, pickedCandidate, metric));
+  }
+
+  sort(deltas.begin(), deltas.end());
+  double tail = (1 - confidence / 100) / 2;
+  low = deltas[min((size_t)resamples - 1, (size_t)(tail * resamples))];
+  high = deltas[min((size_t)resamples - 1, (size_t)((1 - tail) * resamples))];
+}
+
+// Main
+
+/**
+ * Loads both sides, prints a table of deltas with their confidence
+ * intervals and exits with 1 if any metric regressed.
+ *
+ * Options:
+ *   -b F   Add baseline log F (repeat for more trials).
+ *   -c P   Confidence of the intervals in percent (default 95).
+ *   -n N   Bootstrap resamples (default 2000).
+ *   -t P   Smallest change in percent that counts as a regression (default 5).
+ */
+int main(int argc, char **argv) {
+  vector<const char *> basePaths, candidatePaths;
+  int opt;
+
+  while((opt = getopt(argc, argv, "b:c:n:t:")) != -1) {
+    switch(opt) {
+      case 'b': basePaths.push_back(optarg); break;
+      case 'c': confidence = atof(optarg); break;
+      case 'n': resamples = atoi(optarg); break;
+      case 't': tolerance = atof(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-c confidence] [-n resamples] [-t tolerance]"
+                " -b baseline.log ... candidate.log ...\n", argv[0]);
+        return 2;
+    }
+  }
+  for(int i = optind; i < argc; i++) {
+    candidatePaths.push_back(argv[i]);
+  }
+  if(basePaths.empty() || candidatePaths.empty() || resamples < 1 ||
+     confidence <= 0 || confidence >= 100) {
+    fprintf(stderr, "usage: %s [-c confidence] [-n resamples] [-t tolerance]"
+            " -b baseline.log ... candidate.log ...\n", argv[0]);
+    return 2;
+  }
+
+  int slices = basePaths.size() == 1 || candidatePaths.size() == 1 ? SLICES_PER_LOG : 1;
+  vector<Trial> base, candidate;
+  if(!loadSide(basePaths, slices, base) || !loadSide(candidatePaths, slices, candidate)) {
+    return 2;
+  }
+
+  vector<size_t> allBase(base.size()), allCandidate(candidate.size());
+  for(size_t i = 0; i < base.size(); i++) allBase[i] = i;
+  for(size_t i = 0; i < candidate.size(); i++) allCandidate[i] = i;
+
+  printf("%zu baseline trials, %zu candidate trials, %d resamples, tolerance %.1f%%\n",
+         base.size(), candidate.size(), resamples, tolerance);
+  printf("%-14s %12s %12s %9s %22s  %s\n", "metric", "baseline", "candidate", "delta",
+         "CI", "verdict");
+
+  Rng rng(BOOTSTRAP_SEED);
+  int regressions = 0;
+  for(int metric = 0; metric < NUM_METRICS; metric++) {
+    double baseMean = meanOf(base, allBase, metric);
+    double candidateMean = meanOf(candidate, allCandidate, metric);
+    double low, high;
+    bootstrap(base, candidate, metric, rng, low, high);
+
+    // Flip the sign of metrics where lower is better, so worse is always negative
+    double sign = HIGHER_IS_BETTER[metric] ? 1 : -1;
+    double worst = min(sign * low, sign * high), best = max(sign * low, sign * high);
+    const char *verdict = "-";
+    if(best < -tolerance) {
+      verdict = "REGRESSION";
+      regressions++;
+    } else if(worst > tolerance) {
+      verdict = "improved";
+    } else if(worst > 0 || best < 0) {
+      verdict = "within tolerance";
+    }
+
+    char interval[32];
+    snprintf(interval, sizeof(interval), "[%+.1f%%, %+.1f%%]", low, high);
+    printf("%-14s %12.2f %12.2f %+8.1f%% %22s  %s\n", METRIC_NAMES[metric],
+           baseMean * METRIC_SCALE[metric], candidateMean * METRIC_SCALE[metric],
+           deltaOf(baseMean, candidateMean), interval, verdict);
+  }
+
+  printf("%d of %d metrics regressed (%.0f%% confidence)\n", regressions, NUM_METRICS,
+         confidence);
+  return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,1405 @@
+/**
+ * File: lizardsSim.cpp
+ * Authors: Noah Nickles, Dylan Stephens
+ * Based on: lizardsUni.cpp
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Virtual-time version of the unidirectional lizard world. Rather than
+ * one thread per lizard and real sleeps, every lizard is a few bytes of
+ * state in flat arrays and the world is a discrete-event simulation over
+ * integer microseconds. The gates follow lizardsUni: a counting gate
+ * holds MAX_LIZARD_CROSSING spots in FIFO order, and a direction gate
+ * lets lizards walk straight on while the driveway is empty or going
+ * their way, flipping with a convoy when the last lizard leaves.
+ *
+ * World construction is parallel and lazy. The constructor threads only
+ * draw each lizard's first wake-up time and bucket the lizards by it (a
+ * parallel counting sort into a calendar of 1/64 s buckets). Nothing else
+ * about a lizard is touched until its first wake-up, and its random
+ * number generator only materializes when it first needs a new draw.
+ * The calendar feeds wake-ups to the event loop one bucket at a time, so
+ * a world of a million lizards starts crossing within milliseconds.
+ *
+ * A world can also be saved after a warm-up stretch (-w, -o) and
+ * restarted from the snapshot (-i) as often as needed. The snapshot file
+ * holds every lizard's phase, pending timer and random number generator,
+ * the gates, the calendar and the cats, with each array on its own page.
+ * A restore maps the file copy-on-write and points the lizard arrays
+ * straight into the mapping, so only the pages a run actually changes
+ * are ever copied. Restored runs continue exactly where the snapshot left
+ * off, or take a different random future per variant (-S, -r), and the
+ * variants can run in forked workers (-f).
+ *
+ * The event loop can also run on several threads (-p). Lizards only meet
+ * at the gate, and no lizard reaches the other side sooner than the
+ * shortest crossing after it stepped on, so the loop advances in
+ * conservative windows of that length: every exit inside a window is
+ * already known when the window opens. Worker threads each own a share
+ * of the lizards. At the start of a window they draw what every one of
+ * their lizards leaving the driveway does next, collect their lizards'
+ * wake-ups in the window in order, and sort the calendar buckets the
+ * window activates. After a barrier the gate merges it all in the same
+ * order the sequential loop uses, so the results are bit-identical to a
+ * sequential run of the same seed. Windows with too little to share are
+ * prepared on the gate's thread without waking the workers.
+ *
+ * Sweeps of many default-sized worlds can use SmallWorld instead, an
+ * engine specialized at compile time for NUM_LIZARDS lizards and
+ * NUM_CATS cats (smallworld.h). -b runs a batch of worlds through both
+ * engines, checks they agree and compares their speed.
+ */
+
+// C Includes
+#include <fcntl.h>    // For open
+#include <getopt.h>   // For command-line options
+#include <stdio.h>    // For printf
+#include <stdlib.h>   // For calloc
+#include <string.h>   // For strcmp
+#include <sys/mman.h> // For mapping snapshots
+#include <sys/stat.h> // For fstat
+#include <unistd.h>   // For close
+
+// C++ Includes
+#include <algorithm>          // For heaps and sorting
+#include <condition_variable> // For the window barrier
+#include <deque>              // For the gate queues
+#include <mutex>              // For the window barrier
+#include <thread>             // For parallel construction and the parallel loop
+#include <vector>             // For event and calendar storage
+
+// Project Includes
+#include "behavior.h" // For lizard behavior classes and Rng
+#include "crosslog.h" // For monotonicMicros
+#include "smallworld.h" // For the compile-time small-world engine
+#include "sweep.h"    // For running variants in forked workers
+
+// Usings
+using namespace std; // Cleans up code syntax a bit
+
+// Constants
+#define WORLDEND             30 // Virtual seconds for the simulation
+#define NUM_LIZARDS          20 // Number of lizards to create
+#define NUM_CATS              2 // Number of cats to create
+#define MAX_LIZARD_CROSSING   4 // Max allowed lizards on the driveway simultaneously
+#define MAX_LIZARD_SLEEP      3 // Max sleep time for lizards in seconds
+#define MAX_CAT_SLEEP         3 // Max sleep time for cats in seconds
+#define MAX_LIZARD_EAT        5 // Max time lizards spend eating in seconds
+#define CROSS_SECONDS         2 // Time taken by a lizard to cross the driveway
+#define MICROS         1000000ll // Microseconds per virtual second
+#define BUCKET_MICROS     15625 // Width of an activation calendar bucket (1/64 s)
+#define PARALLEL_MIN_WORK  4096 // Lizards a window must touch before the workers share it
+#define SNAPSHOT_MAGIC "LZSNAP01" // First bytes of a snapshot file
+#define SNAPSHOT_PAGE      4096 // Alignment of every array in a snapshot file
+#define SNAPSHOT_MIX_SIZE   128 // Bytes of the behavior mix kept in a snapshot
+
+// Classes/Enums
+
+// Where a lizard is in its loop
+enum Phase : uint8_t {
+  UNBORN,            // Still in the calendar, waiting for its first wake-up
+  SLEEPING,          // Sleeping in the sago
+  AT_SAGO_GATE,      // Waiting to cross sago -> monkey grass
+  CROSSING_TO_GRASS, // On the driveway towards the monkey grass
+  EATING,            // Eating in the monkey grass
+  AT_GRASS_GATE,     // Waiting to cross monkey grass -> sago
+  CROSSING_TO_SAGO,  // On the driveway towards the sago
+  DONE               // Made it home after the end of the world
+};
+
+// What happens at an event; at equal times exits go first
+enum EventKind : uint32_t {
+  EVENT_EXIT, // A lizard reaches the other side of the driveway
+  EVENT_WAKE, // A lizard finishes sleeping or eating
+  EVENT_CAT   // A cat wakes up and checks the driveway
+};
+
+// One scheduled event
+struct Event {
+  int64_t  time; // Virtual microseconds
+  uint32_t kind; // EventKind
+  uint32_t id;   // Lizard or cat
+
+  bool operator>(const Event &other) const {
+    if(time != other.time) return time > other.time;
+    if(kind != other.kind) return kind > other.kind;
+    return id > other.id;
+  }
+};
+
+// Arrays of a snapshot file, in file order
+enum Section {
+  SECTION_RNG,          // Rng state per lizard
+  SECTION_PHASE,        // Phase per lizard
+  SECTION_WAIT_START,   // Gate arrival or wait per lizard
+  SECTION_FIRST_WAKE,   // First wake-up per lizard
+  SECTION_ORDER,        // Activation calendar
+  SECTION_BUCKETS,      // Calendar bucket starts
+  SECTION_EVENTS,       // Event heap, as laid out in memory
+  SECTION_SPOT_QUEUE,   // Lizards waiting for a spot
+  SECTION_TO_GRASS,     // Lizards waiting for the sago -> grass direction
+  SECTION_TO_SAGO,      // Lizards waiting for the grass -> sago direction
+  SECTION_CATS,         // Rng state per cat
+  NUM_SECTIONS
+};
+
+// First page of a snapshot file: the scalars of a world and where its arrays are
+struct SnapshotHeader {
+  char     magic[8];                // SNAPSHOT_MAGIC
+  uint32_t numLizards;
+  int32_t  numCats;
+  int64_t  end;
+  uint64_t seed;
+  char     mix[SNAPSHOT_MIX_SIZE];  // Behavior mix given with -m, "" for the default
+  int64_t  now;
+  uint32_t activated;
+  uint32_t sortedUpTo;
+  uint32_t bucket;
+  int32_t  freeSpots;
+  int32_t  direction;
+  int32_t  crossing[2];
+  uint64_t crossings[2];
+  uint64_t waitMicros;
+  uint64_t events;
+  uint64_t catChecks;
+  uint64_t violations;
+  int64_t  firstStart;
+  int64_t  firstFinish;
+  uint64_t offset[NUM_SECTIONS];    // File offset of each array
+  uint64_t bytes[NUM_SECTIONS];     // Size of each array
+};
+
+/**
+ * Reusable barrier for the threads of the parallel event loop.
+ */
+class WindowBarrier {
+  mutex              _mutex;
+  condition_variable _cv;
+  int                _threads;    // Threads that meet at the barrier
+  int                _waiting;    // Threads at the barrier now
+  uint64_t           _generation; // Times the barrier opened
+
+  public:
+    explicit WindowBarrier(int threads) : _threads(threads), _waiting(0), _generation(0) {}
+
+    /**
+     * Returns once all threads have called wait().
+     */
+    void wait() {
+      unique_lock<mutex> lock(_mutex);
+      uint64_t generation = _generation;
+      if(++_waiting == _threads) {
+        _waiting = 0;
+        _generation++;
+        _cv.notify_all();
+      } else {
+        _cv.wait(lock, [&] { return _generation != generation; });
+      }
+    }
+};
+
+/**
+ * Fixed-size array whose memory comes from calloc. Large allocations are
+ * fresh zero pages from the kernel, so nothing is touched (or even
+ * backed by memory) until a lizard first uses its slot. An array can
+ * also live in a mapped snapshot, which it does not own.
+ */
+template <class T>
+class LazyArray {
+  T   *_data;
+  bool _owned; // Whether _data came from calloc
+
+  public:
+    LazyArray() : _data(nullptr), _owned(false) {}
+    ~LazyArray() { release(); }
+
+    void allocate(size_t size) {
+      release();
+      _data = (T *)calloc(size ? size : 1, sizeof(T));
+      _owned = true;
+    }
+
+    void map(void *data) {
+      release();
+      _data = (T *)data;
+    }
+
+    void release() {
+      if(_owned) {
+        free(_data);
+      }
+      _data = nullptr;
+      _owned = false;
+    }
+
+    T &operator[](size_t i) { return _data[i]; }
+    const T &operator[](size_t i) const { return _data[i]; }
+};
+
+/**
+ * One virtual-time world.
+ */
+class SimWorld {
+  // Settings
+  uint32_t _numLizards;
+  int      _numCats;
+  int64_t  _end;  // Virtual time the world ends
+  uint64_t _seed;
+
+  // Lizards, as flat arrays indexed by lizard id
+  LazyArray<uint64_t> _rng;       // Rng state xor _salt, 0 until materialized
+  LazyArray<uint8_t>  _phase;     // Phase
+  LazyArray<int64_t>  _waitStart; // Gate arrival; the wait once on the driveway
+
+  // Activation calendar: lizard ids ordered by first wake-up bucket
+  LazyArray<int64_t>  _firstWake;   // First wake-up time per lizard
+  LazyArray<uint32_t> _order;       // Lizard ids, bucket by bucket
+  vector<uint32_t>    _bucketStart; // Index in _order where each bucket starts
+  uint32_t            _activated;   // Lizards taken from the calendar so far
+  uint32_t            _sortedUpTo;  // _order is sorted by time up to here
+  uint32_t            _bucket;      // Calendar bucket of the next activation
+
+  // Pending events of activated lizards and cats
+  vector<Event> _events;
+  int64_t       _now;
+
+  // Gates
+  int             _freeSpots;     // Free spots at the counting gate
+  deque<uint32_t> _spotQueue;     // Lizards waiting for a spot
+  int             _direction;     // Current direction, -1 for none
+  int             _crossing[2];   // Lizards on the driveway per direction
+  deque<uint32_t> _directionQueue[2]; // Lizards with a spot waiting for the direction
+  vector<Rng>     _catRng;
+
+  // Restored worlds
+  uint64_t _salt;         // Mixed into every lizard's Rng state, 0 to continue exactly
+  void    *_mapping;      // Snapshot the lizard arrays point into, if restored
+  size_t   _mappingBytes;
+
+  public:
+    // Results
+    uint64_t crossings[2];
+    uint64_t waitMicros;
+    uint64_t events;
+    uint64_t catChecks;
+    uint64_t violations;
+    uint64_t firstStartWall;  // monotonicMicros() when the first lizard stepped on
+    uint64_t firstFinishWall; // monotonicMicros() when the first lizard made it across
+    int64_t  firstStart;      // Virtual time of the first step onto the driveway
+    int64_t  firstFinish;     // Virtual time of the first finished crossing
+    uint64_t windows;         // Windows of the parallel loop
+    uint64_t sharedWindows;   // Windows prepared by all workers together
+
+    SimWorld(uint32_t numLizards, int numCats, int seconds, uint64_t seed);
+    ~SimWorld();
+
+    void construct(int numThreads);
+    void run(int64_t until = INT64_MAX);
+    void runParallel(int numThreads, int64_t until = INT64_MAX);
+    bool save(const char *path, const char *mix, uint64_t &bytes) const;
+    bool restore(const char *path);
+    void perturb(uint64_t variant);
+    int64_t now() const { return _now; }
+    int64_t end() const { return _end; }
+
+  private:
+    // One worker's share of the lizards in the parallel loop
+    struct Partition {
+      vector<Event> exits;  // Exits of its lizards in the current window
+      vector<Event> wakes;  // Heap of its lizards' pending wake-ups
+      vector<Event> window; // Its wake-ups in the current window, in order
+      size_t        next;   // Next event of window for the gate
+    };
+
+    Rng rngOf(uint32_t id) const;
+    const BehaviorClass *behaviorOf(uint32_t id) const;
+    int64_t draw(const Duration &duration, Rng &rng) const;
+
+    bool peekActivation(Event &event);
+    void dispatch(const Event &event);
+    void prepare(Partition &partition, int64_t windowEnd, int index, int numThreads);
+    void schedule(int64_t time, EventKind kind, uint32_t id);
+    void materialize(uint32_t id);
+    int64_t nextWake(uint32_t id, int64_t at);
+    void wake(uint32_t id);
+    void arriveAtGate(uint32_t id);
+    void enterDirection(uint32_t id);
+    void startCrossing(uint32_t id);
+    void finishCrossing(uint32_t id);
+    void leaveDirection(int direction);
+    void catCheck(uint32_t cat);
+};
+
+// Global Variables
+BehaviorMix behaviorMix(MAX_LIZARD_SLEEP, MAX_LIZARD_EAT); // Behavior classes of the population (-m)
+
+// SimWorld Methods
+
+/**
+ * Sets up an empty world.
+ *
+ * @param numLizards - Lizards in the world.
+ * @param numCats    - Cats in the world.
+ * @param seconds    - Virtual seconds until the end of the world.
+ * @param seed       - Seed every lizard's random numbers derive from.
+ */
+SimWorld::SimWorld(uint32_t numLizards, int numCats, int seconds, uint64_t seed)
+  : _numLizards(numLizards), _numCats(numCats), _end(seconds * MICROS), _seed(seed),
+    _activated(0), _sortedUpTo(0), _bucket(0), _now(0), _freeSpots(MAX_LIZARD_CROSSING),
+    _direction(-1), _salt(0), _mapping(nullptr), _mappingBytes(0),
+    waitMicros(0), events(0), catChecks(0), violations(0), firstStartWall(0),
+    firstFinishWall(0), firstStart(-1), firstFinish(-1), windows(0), sharedWindows(0) {
+  _crossing[0] = _crossing[1] = 0;
+  crossings[0] = crossings[1] = 0;
+}
+
+SimWorld::~SimWorld() {
+  _rng.release();
+  _phase.release();
+  _waitStart.release();
+  _firstWake.release();
+  _order.release();
+  if(_mapping) {
+    munmap(_mapping, _mappingBytes);
+  }
+}
+
+/**
+ * Returns the freshly seeded random number generator of a lizard.
+ */
+Rng SimWorld::rngOf(uint32_t id) const {
+  return Rng((_seed << 32) ^ id);
+}
+
+/**
+ * Returns the behavior class of a lizard.
+ */
+const BehaviorClass *SimWorld::behaviorOf(uint32_t id) const {
+  return behaviorMix.classFor((int)id, (int)_numLizards);
+}
+
+/**
+ * Draws a duration in whole virtual microseconds.
+ */
+int64_t SimWorld::draw(const Duration &duration, Rng &rng) const {
+  return (int64_t)(drawDuration(duration, rng) * MICROS + 0.5);
+}
+
+/**
+ * Builds the activation calendar with numThreads threads. Each thread
+ * draws the first wake-up of a contiguous range of lizards and counts
+ * them per bucket; after a prefix sum over (bucket, thread) each thread
+ * scatters its range into place. Lizard order within a bucket stays by
+ * id, so the result does not depend on the number of threads.
+ *
+ * @param numThreads - Threads to construct the world with.
+ */
+void SimWorld::construct(int numThreads) {
+  uint32_t n = _numLizards;
+  if(numThreads < 1) numThreads = 1;
+  if((uint32_t)numThreads > n) numThreads = n ? (int)n : 1;
+
+  _rng.allocate(n);
+  _phase.allocate(n);
+  _waitStart.allocate(n);
+  _firstWake.allocate(n);
+  _order.allocate(n);
+
+  vector<thread>           builders;
+  vector<int64_t>          latest(numThreads, 0);
+  vector<vector<uint32_t>> counts(numThreads);
+  auto rangeOf = [&](int t, uint32_t &begin, uint32_t &end) {
+    begin = (uint32_t)((uint64_t)n * t / numThreads);
+    end = (uint32_t)((uint64_t)n * (t + 1) / numThreads);
+  };
+  auto inParallel = [&](void (*pass)(SimWorld *, int, uint32_t, uint32_t, int64_t &,
+                                      vector<uint32_t> &)) {
+    for(int t = 1; t < numThreads; t++) {
+      builders.emplace_back([&, t, pass] {
+        uint32_t begin, end;
+        rangeOf(t, begin, end);
+        pass(this, t, begin, end, latest[t], counts[t]);
+      });
+    }
+    uint32_t begin, end;
+    rangeOf(0, begin, end);
+    pass(this, 0, begin, end, latest[0], counts[0]);
+    for(auto &builder : builders) {
+      builder.join();
+    }
+    builders.clear();
+  };
+
+  // Pass 1: draw every first wake-up
+  inParallel([](SimWorld *world, int, uint32_t begin, uint32_t end, int64_t &latest,
+                vector<uint32_t> &) {
+    for(uint32_t id = begin; id < end; id++) {
+      Rng rng = world->rngOf(id);
+      int64_t wake = world->draw(world->behaviorOf(id)->sleep, rng);
+      world->_firstWake[id] = wake;
+      latest = max(latest, wake);
+    }
+  });
+  uint32_t numBuckets = (uint32_t)(*max_element(latest.begin(), latest.end()) / BUCKET_MICROS) + 1;
+
+  // Pass 2: count lizards per bucket
+  for(auto &count : counts) {
+    count.assign(numBuckets, 0);
+  }
+  inParallel([](SimWorld *world, int, uint32_t begin, uint32_t end, int64_t &,
+                vector<uint32_t> &count) {
+    for(uint32_t id = begin; id < end; id++) {
+      count[world->_firstWake[id] / BUCKET_MICROS]++;
+    }
+  });
+
+  // Prefix sum: bucket by bucket, and within a bucket thread by thread
+  _bucketStart.assign(numBuckets + 1, 0);
+  uint32_t offset = 0;
+  for(uint32_t b = 0; b < numBuckets; b++) {
+    _bucketStart[b] = offset;
+    for(int t = 0; t < numThreads; t++) {
+      uint32_t count = counts[t][b];
+      counts[t][b] = offset;
+      offset += count;
+    }
+  }
+  _bucketStart[numBuckets] = offset;
+
+  // Pass 3: scatter every lizard into its bucket
+  inParallel([](SimWorld *world, int, uint32_t begin, uint32_t end, int64_t &,
+                vector<uint32_t> &next) {
+    for(uint32_t id = begin; id < end; id++) {
+      world->_order[next[world->_firstWake[id] / BUCKET_MICROS]++] = id;
+    }
+  });
+
+  // Cats start right away
+  for(int cat = 0; cat < _numCats; cat++) {
+    _catRng.emplace_back(((_seed << 32) ^ 0x80000000u) + cat);
+    schedule(draw({ DIST_UNIFORM, (double)MAX_CAT_SLEEP }, _catRng[cat]), EVENT_CAT, cat);
+  }
+}
+
+/**
+ * Processes events in virtual time order until every lizard made it
+ * home after the end of the world. Activated lizards and cats live in a
+ * binary heap; lizards that have not woken yet are read from the
+ * calendar, sorting each bucket by time just before it is reached.
+ *
+ * @param until - Stop before the first event at or after this virtual
+ *                time; run() can be called again to carry on.
+ */
+void SimWorld::run(int64_t until) {
+  for(;;) {
+    // Take whichever comes first: the next activation or the next event
+    Event event;
+    bool activate = peekActivation(event) && (_events.empty() || _events.front() > event);
+    if(!activate) {
+      if(_events.empty()) {
+        return;
+      }
+      event = _events.front();
+    }
+    if(event.time >= until) {
+      return;
+    }
+
+    if(activate) {
+      _activated++;
+    } else {
+      pop_heap(_events.begin(), _events.end(), greater<Event>());
+      _events.pop_back();
+    }
+
+    // What a lizard does after leaving the driveway is its own business
+    if(event.kind == EVENT_EXIT) {
+      int64_t wake = nextWake(event.id, event.time);
+      if(wake >= 0) {
+        schedule(wake, EVENT_WAKE, event.id);
+      }
+    }
+    dispatch(event);
+  }
+}
+
+/**
+ * Same as run(), on numThreads threads, in conservative windows as long
+ * as the shortest crossing. The wake-ups of lizards that have woken at
+ * least once move from the heap to the workers that own them and back
+ * when the loop stops, so the two loops can take turns.
+ *
+ * @param numThreads - Threads to run on, the calling one included.
+ * @param until      - Stop before the first event at or after this time.
+ */
+void SimWorld::runParallel(int numThreads, int64_t until) {
+  if(numThreads < 2) {
+    run(until);
+    return;
+  }
+  int64_t lookahead = (int64_t)(CROSS_SECONDS * behaviorMix.minCrossScale() * MICROS + 0.5);
+
+  // Hand the pending wake-ups to their owners; exits and cats stay with the gate
+  vector<Partition> partitions(numThreads);
+  vector<Event> gate;
+  for(const Event &event : _events) {
+    (event.kind == EVENT_WAKE ? partitions[event.id % numThreads].wakes : gate).push_back(event);
+  }
+  for(Partition &partition : partitions) {
+    make_heap(partition.wakes.begin(), partition.wakes.end(), greater<Event>());
+  }
+  _events.swap(gate);
+  make_heap(_events.begin(), _events.end(), greater<Event>());
+
+  // Workers prepare their share of every shared window
+  WindowBarrier barrier(numThreads);
+  int64_t windowEnd = 0;
+  bool stopping = false;
+  vector<thread> workers;
+  for(int t = 1; t < numThreads; t++) {
+    workers.emplace_back([&, t] {
+      for(;;) {
+        barrier.wait();
+        if(stopping) {
+          return;
+        }
+        prepare(partitions[t], windowEnd, t, numThreads);
+        barrier.wait();
+      }
+    });
+  }
+
+  for(;;) {
+    // The window opens at the earliest pending event
+    Event first;
+    int64_t start = peekActivation(first) ? first.time : INT64_MAX;
+    if(!_events.empty()) {
+      start = min(start, _events.front().time);
+    }
+    for(const Partition &partition : partitions) {
+      if(!partition.wakes.empty()) {
+        start = min(start, partition.wakes.front().time);
+      }
+    }
+    if(start >= until) {
+      break;
+    }
+    windowEnd = min(start + lookahead, until);
+    windows++;
+
+    // Exits in the window go to their owners, which draw what comes next
+    size_t work = 0;
+    for(const Event &event : _events) {
+      if(event.kind == EVENT_EXIT && event.time < windowEnd) {
+        partitions[event.id % numThreads].exits.push_back(event);
+        work++;
+      }
+    }
+    int64_t lastBucket = min<int64_t>((windowEnd - 1) / BUCKET_MICROS, _bucketStart.size() - 2);
+    if(_bucketStart[lastBucket + 1] > _sortedUpTo) {
+      work += _bucketStart[lastBucket + 1] - _sortedUpTo; // Calendar lizards left to sort
+    }
+
+    if(work >= PARALLEL_MIN_WORK) {
+      sharedWindows++;
+      barrier.wait();
+      prepare(partitions[0], windowEnd, 0, numThreads);
+      barrier.wait();
+    } else {
+      for(int t = 0; t < numThreads; t++) {
+        prepare(partitions[t], windowEnd, t, numThreads);
+      }
+    }
+
+    // Merge activations, gate events and the workers' wake-ups in order
+    for(;;) {
+      Event event;
+      int source = -2; // -2 for the calendar, -1 for the gate heap, else the partition
+      bool found = peekActivation(event);
+      if(!_events.empty() && (!found || event > _events.front())) {
+        event = _events.front();
+        source = -1;
+        found = true;
+      }
+      for(int t = 0; t < numThreads; t++) {
+        const Partition &partition = partitions[t];
+        if(partition.next < partition.window.size() &&
+           (!found || event > partition.window[partition.next])) {
+          event = partition.window[partition.next];
+          source = t;
+          found = true;
+        }
+      }
+      if(!found || event.time >= windowEnd) {
+        break;
+      }
+
+      if(source == -2) {
+        _activated++;
+      } else if(source == -1) {
+        pop_heap(_events.begin(), _events.end(), greater<Event>());
+        _events.pop_back();
+      } else {
+        partitions[source].next++;
+      }
+      dispatch(event);
+    }
+  }
+
+  stopping = true;
+  barrier.wait();
+  for(auto &worker : workers) {
+    worker.join();
+  }
+
+  // Give the wake-ups back to the heap for run() and save()
+  for(const Partition &partition : partitions) {
+    for(const Event &event : partition.wakes) {
+      schedule(event.time, EVENT_WAKE, event.id);
+    }
+  }
+}
+
+/**
+ * Gets one worker's share of a window ready: draws what its lizards
+ * leaving the driveway in the window do next, takes its wake-ups in the
+ * window off its heap, and sorts its share of the calendar buckets the
+ * window activates. Touches only its own lizards and buckets.
+ *
+ * @param windowEnd  - First virtual time after the window.
+ * @param index      - The worker, from 0 to numThreads - 1.
+ * @param numThreads - Workers in the loop.
+ */
+void SimWorld::prepare(Partition &partition, int64_t windowEnd, int index, int numThreads) {
+  for(const Event &exit : partition.exits) {
+    int64_t wake = nextWake(exit.id, exit.time);
+    if(wake >= 0) {
+      partition.wakes.push_back({ wake, EVENT_WAKE, exit.id });
+      push_heap(partition.wakes.begin(), partition.wakes.end(), greater<Event>());
+    }
+  }
+  partition.exits.clear();
+
+  partition.window.clear();
+  partition.next = 0;
+  while(!partition.wakes.empty() && partition.wakes.front().time < windowEnd) {
+    pop_heap(partition.wakes.begin(), partition.wakes.end(), greater<Event>());
+    partition.window.push_back(partition.wakes.back());
+    partition.wakes.pop_back();
+  }
+
+  // Buckets past the sorted part of the calendar, dealt out round robin
+  auto byWake = [this](uint32_t a, uint32_t b) {
+    return _firstWake[a] != _firstWake[b] ? _firstWake[a] < _firstWake[b] : a < b;
+  };
+  uint32_t numBuckets = (uint32_t)_bucketStart.size() - 1;
+  for(uint32_t b = _bucket + index; b < numBuckets && (int64_t)b * BUCKET_MICROS < windowEnd;
+      b += numThreads) {
+    if(_bucketStart[b] >= _sortedUpTo && _bucketStart[b] < _bucketStart[b + 1]) {
+      uint32_t *begin = &_order[_bucketStart[b]];
+      uint32_t *end = &_order[_bucketStart[b + 1]];
+      if(!is_sorted(begin, end, byWake)) {
+        sort(begin, end, byWake);
+      }
+    }
+  }
+}
+
+/**
+ * Finds the next lizard to take from the calendar, sorting its bucket
+ * first if the sorted part of the calendar is used up.
+ *
+ * @param event - Set to the lizard's first wake-up.
+ * @return false if every lizard has been activated.
+ */
+bool SimWorld::peekActivation(Event &event) {
+  if(_activated >= _numLizards) {
+    return false;
+  }
+  if(_activated == _sortedUpTo) {
+    while(_bucketStart[_bucket + 1] <= _activated) {
+      _bucket++;
+    }
+    uint32_t *begin = &_order[_bucketStart[_bucket]];
+    uint32_t *end = &_order[_bucketStart[_bucket + 1]];
+    auto byWake = [this](uint32_t a, uint32_t b) {
+      return _firstWake[a] != _firstWake[b] ? _firstWake[a] < _firstWake[b] : a < b;
+    };
+    if(!is_sorted(begin, end, byWake)) {
+      sort(begin, end, byWake);
+    }
+    _sortedUpTo = _bucketStart[_bucket + 1];
+  }
+
+  uint32_t id = _order[_activated];
+  event = { _firstWake[id], EVENT_WAKE, id };
+  return true;
+}
+
+/**
+ * Processes one event at the gate. An exit's next wake-up has already
+ * been drawn and scheduled by then.
+ */
+void SimWorld::dispatch(const Event &event) {
+  _now = event.time;
+  events++;
+  switch(event.kind) {
+    case EVENT_EXIT: finishCrossing(event.id); break;
+    case EVENT_WAKE: wake(event.id); break;
+    case EVENT_CAT:  catCheck(event.id); break;
+  }
+}
+
+/**
+ * Adds an event to the heap.
+ */
+void SimWorld::schedule(int64_t time, EventKind kind, uint32_t id) {
+  _events.push_back({ time, kind, id });
+  push_heap(_events.begin(), _events.end(), greater<Event>());
+}
+
+/**
+ * Gives a lizard its random number generator the first time it needs a
+ * draw: seeds it and replays the draw of its first sleep.
+ */
+void SimWorld::materialize(uint32_t id) {
+  Rng rng = rngOf(id);
+  draw(behaviorOf(id)->sleep, rng);
+  _rng[id] = rng.state();
+}
+
+/**
+ * A lizard finished sleeping or eating and heads for the gate.
+ */
+void SimWorld::wake(uint32_t id) {
+  _phase[id] = _phase[id] == EATING ? AT_GRASS_GATE : AT_SAGO_GATE;
+  arriveAtGate(id);
+}
+
+/**
+ * Takes a spot at the counting gate if one is free, else gets in line.
+ */
+void SimWorld::arriveAtGate(uint32_t id) {
+  _waitStart[id] = _now;
+  if(_freeSpots > 0) {
+    _freeSpots--;
+    enterDirection(id);
+  } else {
+    _spotQueue.push_back(id);
+  }
+}
+
+/**
+ * Crosses right away if the driveway is empty or going this lizard's
+ * way, else waits for the direction to flip.
+ */
+void SimWorld::enterDirection(uint32_t id) {
+  int direction = _phase[id] == AT_SAGO_GATE ? 0 : 1;
+  if(_direction < 0 || _direction == direction) {
+    _direction = direction;
+    startCrossing(id);
+  } else {
+    _directionQueue[direction].push_back(id);
+  }
+}
+
+/**
+ * Steps onto the driveway and schedules reaching the other side.
+ */
+void SimWorld::startCrossing(uint32_t id) {
+  int direction = _phase[id] == AT_SAGO_GATE ? 0 : 1;
+  _crossing[direction]++;
+  _phase[id] = direction == 0 ? CROSSING_TO_GRASS : CROSSING_TO_SAGO;
+  _waitStart[id] = _now - _waitStart[id];
+  if(firstStart < 0) {
+    firstStart = _now;
+    firstStartWall = monotonicMicros();
+  }
+  schedule(_now + (int64_t)(CROSS_SECONDS * behaviorOf(id)->crossScale * MICROS + 0.5),
+           EVENT_EXIT, id);
+}
+
+/**
+ * Reaches the other side: leaves the direction gate, frees the spot and
+ * goes on to eat, sleep or stop.
+ */
+void SimWorld::finishCrossing(uint32_t id) {
+  int direction = _phase[id] == CROSSING_TO_GRASS ? 0 : 1;
+  crossings[direction]++;
+  waitMicros += _waitStart[id];
+  if(firstFinish < 0) {
+    firstFinish = _now;
+    firstFinishWall = monotonicMicros();
+  }
+
+  leaveDirection(direction);
+
+  // Hand the spot to the next lizard in line
+  if(_spotQueue.empty()) {
+    _freeSpots++;
+  } else {
+    uint32_t next = _spotQueue.front();
+    _spotQueue.pop_front();
+    enterDirection(next);
+  }
+
+  // Eat, sleep, or stop if the world has ended
+  _phase[id] = direction == 0 ? EATING : _now < _end ? SLEEPING : DONE;
+}
+
+/**
+ * Draws how long a lizard leaving the driveway eats or sleeps. Only
+ * touches the lizard's own random number generator, so the lizards of
+ * one window can draw in any order.
+ *
+ * @param at - Virtual time the lizard reaches the other side.
+ * @return When the lizard next heads for the gate, -1 if it stays home.
+ */
+int64_t SimWorld::nextWake(uint32_t id, int64_t at) {
+  bool toGrass = _phase[id] == CROSSING_TO_GRASS;
+  if(!toGrass && at >= _end) {
+    return -1;
+  }
+
+  if(!_rng[id]) {
+    materialize(id);
+  }
+  Rng rng;
+  rng.setState(_rng[id] ^ _salt);
+  const BehaviorClass *behavior = behaviorOf(id);
+  int64_t wake = at + draw(toGrass ? behavior->eat : behavior->sleep, rng);
+  _rng[id] = rng.state() ^ _salt;
+  return wake;
+}
+
+/**
+ * Counts a lizard off the driveway. The last one out flips the gate and
+ * admits a convoy of up to MAX_LIZARD_CROSSING waiting lizards.
+ */
+void SimWorld::leaveDirection(int direction) {
+  if(--_crossing[direction] > 0) {
+    return;
+  }
+
+  int next = _directionQueue[1 - direction].empty() ? direction : 1 - direction;
+  deque<uint32_t> &queue = _directionQueue[next];
+  if(queue.empty()) {
+    _direction = -1;
+    return;
+  }
+
+  _direction = next;
+  for(int admitted = 0; admitted < MAX_LIZARD_CROSSING && !queue.empty(); admitted++) {
+    uint32_t id = queue.front();
+    queue.pop_front();
+    startCrossing(id);
+  }
+}
+
+/**
+ * A cat wakes up, looks at the driveway and goes back to sleep.
+ */
+void SimWorld::catCheck(uint32_t cat) {
+  catChecks++;
+  if(_crossing[0] + _crossing[1] > MAX_LIZARD_CROSSING || (_crossing[0] && _crossing[1])) {
+    violations++;
+  }
+  if(_now < _end) {
+    schedule(_now + draw({ DIST_UNIFORM, (double)MAX_CAT_SLEEP }, _catRng[cat]), EVENT_CAT, cat);
+  }
+}
+
+/**
+ * Writes the whole world to a snapshot file. Every array starts on its
+ * own page so a restore can map it in place.
+ *
+ * @param mix   - Behavior mix the world was built with, "" for the default.
+ * @param bytes - Set to the size of the file.
+ * @return false if the file could not be written.
+ */
+bool SimWorld::save(const char *path, const char *mix, uint64_t &bytes) const {
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.numLizards = _numLizards;
+  header.numCats = _numCats;
+  header.end = _end;
+  header.seed = _seed;
+  strncpy(header.mix, mix, SNAPSHOT_MIX_SIZE - 1);
+  header.now = _now;
+  header.activated = _activated;
+  header.sortedUpTo = _sortedUpTo;
+  header.bucket = _bucket;
+  header.freeSpots = _freeSpots;
+  header.direction = _direction;
+  header.crossing[0] = _crossing[0];
+  header.crossing[1] = _crossing[1];
+  header.crossings[0] = crossings[0];
+  header.crossings[1] = crossings[1];
+  header.waitMicros = waitMicros;
+  header.events = events;
+  header.catChecks = catChecks;
+  header.violations = violations;
+  header.firstStart = firstStart;
+  header.firstFinish = firstFinish;
+
+  // The queues and cats are not flat arrays in memory; flatten them first
+  vector<uint32_t> spotQueue(_spotQueue.begin(), _spotQueue.end());
+  vector<uint32_t> toGrass(_directionQueue[0].begin(), _directionQueue[0].end());
+  vector<uint32_t> toSago(_directionQueue[1].begin(), _directionQueue[1].end());
+  vector<uint64_t> cats;
+  for(const Rng &rng : _catRng) {
+    cats.push_back(rng.state());
+  }
+
+  size_t n = _numLizards;
+  const void *data[NUM_SECTIONS] = {
+    &_rng[0], &_phase[0], &_waitStart[0], &_firstWake[0], &_order[0], _bucketStart.data(),
+    _events.data(), spotQueue.data(), toGrass.data(), toSago.data(), cats.data()
+  };
+  const size_t sizes[NUM_SECTIONS] = {
+    n * sizeof(uint64_t), n * sizeof(uint8_t), n * sizeof(int64_t), n * sizeof(int64_t),
+    n * sizeof(uint32_t), _bucketStart.size() * sizeof(uint32_t), _events.size() * sizeof(Event),
+    spotQueue.size() * sizeof(uint32_t), toGrass.size() * sizeof(uint32_t),
+    toSago.size() * sizeof(uint32_t), cats.size() * sizeof(uint64_t)
+  };
+  uint64_t offset = SNAPSHOT_PAGE;
+  for(int section = 0; section < NUM_SECTIONS; section++) {
+    header.offset[section] = offset;
+    header.bytes[section] = sizes[section];
+    offset += (sizes[section] + SNAPSHOT_PAGE - 1) / SNAPSHOT_PAGE * SNAPSHOT_PAGE;
+  }
+  bytes = offset;
+
+  FILE *file = fopen(path, "wb");
+  if(!file) {
+    perror(path);
+    return false;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+  for(int section = 0; section < NUM_SECTIONS && written; section++) {
+    written = fseek(file, (long)header.offset[section], SEEK_SET) == 0 &&
+              fwrite(data[section], 1, sizes[section], file) == sizes[section];
+  }
+  // Pad the last page so every section can be mapped whole
+  written = written && ftruncate(fileno(file), (off_t)bytes) == 0;
+  if(fclose(file) != 0 || !written) {
+    perror(path);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Replaces this world with the one in a snapshot file. The file is mapped
+ * copy-on-write: the per-lizard arrays are used in place and only the
+ * event heap and the gate queues are copied out.
+ *
+ * @return false if the file could not be mapped or is not a snapshot.
+ */
+bool SimWorld::restore(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    perror(path);
+    return false;
+  }
+  struct stat info;
+  if(fstat(fd, &info) < 0) {
+    perror(path);
+    close(fd);
+    return false;
+  }
+  size_t size = (size_t)info.st_size;
+  void *mapping = size >= sizeof(SnapshotHeader)
+                  ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if(mapping == MAP_FAILED) {
+    fprintf(stderr, "%s: cannot map snapshot\n", path);
+    return false;
+  }
+
+  // Check the header before trusting any of its offsets
+  const SnapshotHeader &header = *(const SnapshotHeader *)mapping;
+  bool valid = memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+               header.mix[SNAPSHOT_MIX_SIZE - 1] == 0;
+  for(int section = 0; section < NUM_SECTIONS && valid; section++) {
+    valid = header.offset[section] % SNAPSHOT_PAGE == 0 && header.offset[section] <= size &&
+            header.bytes[section] <= size - header.offset[section];
+  }
+  valid = valid && header.bytes[SECTION_RNG] == header.numLizards * sizeof(uint64_t) &&
+          header.bytes[SECTION_PHASE] == header.numLizards * sizeof(uint8_t) &&
+          header.bytes[SECTION_WAIT_START] == header.numLizards * sizeof(int64_t) &&
+          header.bytes[SECTION_FIRST_WAKE] == header.numLizards * sizeof(int64_t) &&
+          header.bytes[SECTION_ORDER] == header.numLizards * sizeof(uint32_t) &&
+          header.bytes[SECTION_CATS] == header.numCats * sizeof(uint64_t);
+  if(!valid || (header.mix[0] && !behaviorMix.parse(header.mix))) {
+    fprintf(stderr, "%s: not a lizardsSim snapshot\n", path);
+    munmap(mapping, size);
+    return false;
+  }
+
+  // Point the lizard arrays into the mapping
+  char *base = (char *)mapping;
+  _rng.map(base + header.offset[SECTION_RNG]);
+  _phase.map(base + header.offset[SECTION_PHASE]);
+  _waitStart.map(base + header.offset[SECTION_WAIT_START]);
+  _firstWake.map(base + header.offset[SECTION_FIRST_WAKE]);
+  _order.map(base + header.offset[SECTION_ORDER]);
+  if(_mapping) {
+    munmap(_mapping, _mappingBytes);
+  }
+  _mapping = mapping;
+  _mappingBytes = size;
+
+  // Copy out what lives in containers
+  auto ids = [&](int section) {
+    const uint32_t *begin = (const uint32_t *)(base + header.offset[section]);
+    return deque<uint32_t>(begin, begin + header.bytes[section] / sizeof(uint32_t));
+  };
+  const uint32_t *buckets = (const uint32_t *)(base + header.offset[SECTION_BUCKETS]);
+  _bucketStart.assign(buckets, buckets + header.bytes[SECTION_BUCKETS] / sizeof(uint32_t));
+  const Event *heap = (const Event *)(base + header.offset[SECTION_EVENTS]);
+  _events.assign(heap, heap + header.bytes[SECTION_EVENTS] / sizeof(Event));
+  _spotQueue = ids(SECTION_SPOT_QUEUE);
+  _directionQueue[0] = ids(SECTION_TO_GRASS);
+  _directionQueue[1] = ids(SECTION_TO_SAGO);
+  const uint64_t *cats = (const uint64_t *)(base + header.offset[SECTION_CATS]);
+  _catRng.assign(header.numCats, Rng());
+  for(int cat = 0; cat < header.numCats; cat++) {
+    _catRng[cat].setState(cats[cat]);
+  }
+
+  _numLizards = header.numLizards;
+  _numCats = header.numCats;
+  _end = header.end;
+  _seed = header.seed;
+  _now = header.now;
+  _activated = header.activated;
+  _sortedUpTo = header.sortedUpTo;
+  _bucket = header.bucket;
+  _freeSpots = header.freeSpots;
+  _direction = header.direction;
+  _crossing[0] = header.crossing[0];
+  _crossing[1] = header.crossing[1];
+  _salt = 0;
+  crossings[0] = header.crossings[0];
+  crossings[1] = header.crossings[1];
+  waitMicros = header.waitMicros;
+  events = header.events;
+  catChecks = header.catChecks;
+  violations = header.violations;
+  firstStart = header.firstStart;
+  firstFinish = header.firstFinish;
+  firstStartWall = firstFinishWall = 0;
+  return true;
+}
+
+/**
+ * Sends a restored world down a different random future. Call right
+ * after restore(). Variant 0 leaves the world alone, so it continues
+ * exactly as the saved run did; any other variant mixes a scrambled copy
+ * of its number into every random number generator, lazily for lizards
+ * as they next draw.
+ */
+void SimWorld::perturb(uint64_t variant) {
+  _salt = variant ? Rng(variant).state() : 0;
+  for(Rng &rng : _catRng) {
+    rng.setState(rng.state() ^ _salt);
+  }
+}
+
+// Main
+
+/**
+ * Prints what happened in a world that ran until every lizard was home.
+ *
+ * @param micros - Wall time the event loop took.
+ */
+void printResults(const SimWorld &world, uint64_t micros) {
+  uint64_t total = world.crossings[0] + world.crossings[1];
+  printf("virtual time         %.3f s (world ends at %.0f s)\n", world.now() / 1e6,
+         world.end() / 1e6);
+  printf("crossings            %llu sago -> grass, %llu grass -> sago\n",
+         (unsigned long long)world.crossings[0], (unsigned long long)world.crossings[1]);
+  printf("mean wait            %.1f ms\n", total ? world.waitMicros / 1e3 / total : 0.0);
+  printf("cat checks           %llu (%llu violations)\n", (unsigned long long)world.catChecks,
+         (unsigned long long)world.violations);
+  printf("events               %llu in %.3f s (%.2f M events/s)\n",
+         (unsigned long long)world.events, micros / 1e6,
+         micros ? world.events / (double)micros : 0.0);
+  if(world.windows) {
+    printf("parallel windows     %llu (%llu shared by the workers)\n",
+           (unsigned long long)world.windows, (unsigned long long)world.sharedWindows);
+  }
+}
+
+/**
+ * Runs numWorlds default-sized worlds, seeded seed to seed + numWorlds
+ * - 1, once with SimWorld and once with SmallWorld, and prints how fast
+ * each engine got through them and whether they agreed on every world.
+ *
+ * @return 0 if both engines gave the same results for every world.
+ */
+int runBenchmark(int numWorlds, int seconds, uint64_t seed) {
+  typedef SmallWorld<NUM_LIZARDS, NUM_CATS, MAX_LIZARD_CROSSING> DefaultWorld;
+
+  // Results of every world, dynamic engine first
+  struct Outcome {
+    uint64_t crossings[2];
+    uint64_t waitMicros;
+    uint64_t events;
+    uint64_t catChecks;
+    uint64_t violations;
+
+    bool operator!=(const Outcome &other) const {
+      return memcmp(this, &other, sizeof(Outcome)) != 0;
+    }
+  };
+  vector<Outcome> dynamic(numWorlds), fixed(numWorlds);
+  uint64_t events = 0;
+
+  uint64_t started = monotonicMicros();
+  for(int w = 0; w < numWorlds; w++) {
+    SimWorld world(NUM_LIZARDS, NUM_CATS, seconds, seed + w);
+    world.construct(1);
+    world.run();
+    dynamic[w] = { { world.crossings[0], world.crossings[1] }, world.waitMicros, world.events,
+                   world.catChecks, world.violations };
+    events += world.events;
+  }
+  uint64_t dynamicMicros = monotonicMicros() - started;
+
+  started = monotonicMicros();
+  for(int w = 0; w < numWorlds; w++) {
+    DefaultWorld world(behaviorMix, CROSS_SECONDS, MAX_CAT_SLEEP, seconds, seed + w);
+    world.run();
+    fixed[w] = { { world.crossings[0], world.crossings[1] }, world.waitMicros, world.events,
+                 world.catChecks, world.violations };
+  }
+  uint64_t fixedMicros = monotonicMicros() - started;
+
+  int agreed = 0;
+  for(int w = 0; w < numWorlds; w++) {
+    if(dynamic[w] != fixed[w]) {
+      printf("world %d (seed %llu) differs: %llu vs %llu crossings, %llu vs %llu events\n", w,
+             (unsigned long long)(seed + w),
+             (unsigned long long)(dynamic[w].crossings[0] + dynamic[w].crossings[1]),
+             (unsigned long long)(fixed[w].crossings[0] + fixed[w].crossings[1]),
+             (unsigned long long)dynamic[w].events, (unsigned long long)fixed[w].events);
+    } else {
+      agreed++;
+    }
+  }
+
+  printf("worlds               %d of %d lizards, %d cats, %d s (seeds from %llu)\n", numWorlds,
+         NUM_LIZARDS, NUM_CATS, seconds, (unsigned long long)seed);
+  printf("%-20s %12s %12s %14s\n", "engine", "ms/world", "worlds/s", "M events/s");
+  printf("%-20s %12.4f %12.0f %14.2f\n", "SimWorld", dynamicMicros / 1e3 / numWorlds,
+         dynamicMicros ? numWorlds * 1e6 / dynamicMicros : 0.0,
+         dynamicMicros ? events / (double)dynamicMicros : 0.0);
+  printf("%-20s %12.4f %12.0f %14.2f\n", "SmallWorld", fixedMicros / 1e3 / numWorlds,
+         fixedMicros ? numWorlds * 1e6 / fixedMicros : 0.0,
+         fixedMicros ? events / (double)fixedMicros : 0.0);
+  printf("speed-up             %.2fx, same results in %d of %d worlds\n",
+         fixedMicros ? dynamicMicros / (double)fixedMicros : 0.0, agreed, numWorlds);
+  return agreed == numWorlds ? 0 : 1;
+}
+
+/**
+ * Restores and runs -r variants of a snapshot, in this process or in
+ * forked workers, and prints one line per variant.
+ *
+ * @param numLoopThreads - Threads of each variant's event loop.
+ * @return 0 if every variant ran to the end.
+ */
+int runVariants(const char *input, int numWorlds, int numWorkers, uint64_t seed,
+                int numLoopThreads) {
+  WorldSweep worldSweep;
+
+  if(numWorkers > 0) {
+    int crashed = worldSweep.run(numWorkers, numWorlds, (uint32_t)seed, [&] {
+      SimWorld world(0, 0, 0, 0);
+      if(!world.restore(input)) {
+        worldSweep.violation("Cannot restore the snapshot.");
+        exit(-1);
+      }
+      world.perturb(worldSweep.worldSeed());
+      world.runParallel(numLoopThreads);
+      worldSweep.countTotals(world.crossings, world.waitMicros);
+    });
+    return crashed == 0 ? 0 : 1;
+  }
+
+  printf("%8s %10s %8s %8s %14s %11s %10s\n", "variant", "seed", "s->g", "g->s",
+         "mean wait ms", "restore ms", "run ms");
+  for(int w = 0; w < numWorlds; w++) {
+    uint64_t started = monotonicMicros();
+    SimWorld world(0, 0, 0, 0);
+    if(!world.restore(input)) {
+      return 1;
+    }
+    world.perturb(seed + w);
+    uint64_t restored = monotonicMicros();
+    world.runParallel(numLoopThreads);
+    uint64_t finished = monotonicMicros();
+
+    uint64_t total = world.crossings[0] + world.crossings[1];
+    printf("%8d %10llu %8llu %8llu %14.1f %11.3f %10.1f\n", w, (unsigned long long)(seed + w),
+           (unsigned long long)world.crossings[0], (unsigned long long)world.crossings[1],
+           total ? world.waitMicros / 1e3 / total : 0.0, (restored - started) / 1e3,
+           (finished - restored) / 1e3);
+  }
+  return 0;
+}
+
+/**
+ * Builds and runs one virtual-time world and reports how fast it got
+ * going and what happened in it.
+ *
+ * Options:
+ *   -n N   Put N lizards in the world instead of NUM_LIZARDS.
+ *   -c N   Put N cats in the world instead of NUM_CATS.
+ *   -t N   Simulate N virtual seconds instead of WORLDEND.
+ *   -j N   Construct the world with N threads (default: one per core).
+ *   -p N   Run the event loop on N threads (default 1, the sequential
+ *          loop). Results do not depend on N.
+ *   -m M   Mix of lizard behavior classes, e.g. "uniform=80,bursty=20".
+ *   -S N   Seed the world with N instead of the time. With -i, the
+ *          variant seed instead (default 0, which continues exactly).
+ *   -o F   Save the world to snapshot file F after the warm-up ...
+ *   -w N   ... of N virtual seconds (default 0, right after construction).
+ *   -i F   Restore the world from snapshot file F instead of building it;
+ *          -n, -c, -t and -m come from the snapshot.
+ *   -r N   With -i, run N variants of the snapshot, seeded -S to -S + N - 1.
+ *   -f N   Run the -r variants in N forked workers.
+ *   -b N   Run N default-sized worlds, seeded -S onwards, through both
+ *          SimWorld and the compile-time SmallWorld and compare them.
+ */
+int main(int argc, char **argv) {
+  uint64_t started = monotonicMicros();
+  uint32_t numLizards = NUM_LIZARDS;
+  int numCats = NUM_CATS;
+  int seconds = WORLDEND;
+  int numThreads = (int)thread::hardware_concurrency();
+  int numLoopThreads = 1;    // Threads of the event loop (-p)
+  uint64_t seed = (uint64_t)time(NULL);
+  bool seeded = false;       // Whether -S was given
+  const char *mix = "";      // Behavior mix given with -m
+  const char *input = NULL;  // Snapshot to restore (-i)
+  const char *output = NULL; // Snapshot to save (-o)
+  int warmup = 0;            // Virtual seconds before the snapshot is saved
+  int numWorlds = 1;         // Variants of a restored snapshot
+  int numWorkers = 0;        // Worker processes for the variants, 0 to stay in process
+  int numBenchmark = 0;      // Worlds to run through both engines (-b)
+  int opt;
+
+  while((opt = getopt(argc, argv, "b:c:f:i:j:m:n:o:p:r:S:t:w:")) != -1) {
+    switch(opt) {
+      case 'b': numBenchmark = atoi(optarg); break;
+      case 'c': numCats = atoi(optarg); break;
+      case 'f': numWorkers = atoi(optarg); break;
+      case 'i': input = optarg; break;
+      case 'j': numThreads = atoi(optarg); break;
+      case 'm':
+        if(strlen(optarg) >= SNAPSHOT_MIX_SIZE || !behaviorMix.parse(optarg)) {
+          fprintf(stderr, "bad behavior mix '%s'; classes are " BEHAVIOR_NAMES "\n", optarg);
+          return 1;
+        }
+        mix = optarg;
+        break;
+      case 'n': numLizards = (uint32_t)strtoul(optarg, NULL, 10); break;
+      case 'o': output = optarg; break;
+      case 'p': numLoopThreads = atoi(optarg); break;
+      case 'r': numWorlds = atoi(optarg); break;
+      case 'S': seed = strtoull(optarg, NULL, 10); seeded = true; break;
+      case 't': seconds = atoi(optarg); break;
+      case 'w': warmup = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-c cats] [-j threads] [-m mix] [-n lizards] [-p threads]"
+                " [-S seed] [-t seconds]\n"
+                "       [-o snapshot [-w seconds]] [-i snapshot [-r variants] [-f workers]] [-b worlds]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+
+  // Variants come from a snapshot; a snapshot comes from a built world
+  if(input && output) {
+    fprintf(stderr, "-i and -o cannot be combined\n");
+    return 1;
+  }
+  if(!input && (numWorlds != 1 || numWorkers > 0)) {
+    fprintf(stderr, "-r and -f need a snapshot to restore (-i)\n");
+    return 1;
+  }
+
+  // The small-world engine is compiled for the default world only
+  if(numBenchmark > 0) {
+    if(input || output || numLoopThreads != 1 || numLizards != NUM_LIZARDS || numCats != NUM_CATS) {
+      fprintf(stderr, "-b runs worlds of %d lizards and %d cats, without -i, -o or -p\n",
+              NUM_LIZARDS, NUM_CATS);
+      return 1;
+    }
+    return runBenchmark(numBenchmark, seconds, seed);
+  }
+
+  // Warm-started runs: every variant maps the snapshot afresh
+  if(input) {
+    if(!seeded) {
+      seed = 0;
+    }
+    if(numWorlds != 1 || numWorkers > 0) {
+      return runVariants(input, numWorlds, numWorkers, seed, numLoopThreads);
+    }
+
+    SimWorld world(0, 0, 0, 0);
+    if(!world.restore(input)) {
+      return 1;
+    }
+    world.perturb(seed);
+    uint64_t restored = monotonicMicros();
+    printf("restored             %s at virtual %.3f s in %.2f ms (variant %llu)\n", input,
+           world.now() / 1e6, (restored - started) / 1e3, (unsigned long long)seed);
+    world.runParallel(numLoopThreads);
+    uint64_t finished = monotonicMicros();
+
+    printResults(world, finished - restored);
+    return 0;
+  }
+
+  // Build the world, then let it run until every lizard is home
+  SimWorld world(numLizards, numCats, seconds, seed);
+  world.construct(numThreads);
+  uint64_t built = monotonicMicros();
+
+  // Save it after the warm-up and carry on, so the run doubles as a reference
+  uint64_t saveMicros = 0, bytes = 0;
+  int64_t savedAt = 0;
+  if(output) {
+    world.runParallel(numLoopThreads, warmup * MICROS);
+    savedAt = world.now();
+    uint64_t warm = monotonicMicros();
+    if(!world.save(output, mix, bytes)) {
+      return 1;
+    }
+    saveMicros = monotonicMicros() - warm;
+  }
+  world.runParallel(numLoopThreads);
+  uint64_t finished = monotonicMicros();
+
+  printf("lizards              %u (%d cats, seed %llu)\n", numLizards, numCats,
+         (unsigned long long)seed);
+  printf("construction         %.2f ms (%d threads)\n", (built - started) / 1e3, numThreads);
+  if(world.firstStart >= 0 && world.firstStartWall) {
+    printf("first crossing       %.2f ms after start (virtual %.3f s)\n",
+           (world.firstStartWall - started) / 1e3, world.firstStart / 1e6);
+    printf("first made it        %.2f ms after start (virtual %.3f s)\n",
+           (world.firstFinishWall - started) / 1e3, world.firstFinish / 1e6);
+  }
+  if(output) {
+    printf("snapshot             %s at virtual %.3f s, %.1f MB in %.2f ms\n", output,
+           savedAt / 1e6, bytes / 1e6, saveMicros / 1e3);
+  }
+  printResults(world, finished - built - saveMicros);
+  return 0;
+}
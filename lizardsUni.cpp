@@ -10,8 +10,13 @@
  * implements unidirectional crossing. If multiple lizards are
  * crossing in opposite directions, the lizards run into each other
  * causing the cats to "play" with them.
- * Using a condition variable, a mutex, and a semaphore prevents
- * this from happening.
+ * A multi-class gate (classgate.h) limits how many lizards are on the
+ * driveway, with an optional reserved spot and weighted fair queueing
+ * for emergency lizards, and a
+ * mutex-guarded direction gate with one wait queue per direction
+ * prevents this from happening. When the last lizard of a direction
+ * leaves, the gate flips and admits a whole convoy of waiting lizards
+ * from the other side at once.
  */
 
 // C Includes
@@ -20,14 +25,29 @@
 #include <string.h>    // For string manipulation functions
 #include <unistd.h>    // For sleep function
 #include <semaphore.h> // For POSIX semaphores
+#include <getopt.h>    // For long command-line options
 
 // C++ Inlcudes
-#include <condition_variable> // For thread synchronization
 #include <iostream>           // For standard I/O stream
 #include <mutex>              // For manging critial sections
 #include <thread>             // For creating threads
 #include <vector>             // For storing objects to create threads from
 
+// Project Includes
+#include "behavior.h"  // For lizard behavior classes
+#include "biasgate.h"  // For the biased direction gate
+#include "classgate.h" // For the multi-class driveway gate
+#include "counters.h"  // For the lock-free crossing counters
+#include "crosslog.h"  // For the binary crossing log
+#include "driveway.h"  // For the pipelined driveway
+#include "inspect.h"   // For the cat inspection engine
+#include "loadgen.h"   // For the open-loop load generator
+#include "logger.h"    // For the asynchronous debug log
+#include "occupancy.h" // For who is on the driveway
+#include "profile.h"   // For the optional per-phase profiler
+#include "sweep.h"     // For forked world sweeps
+#include "threads.h"   // For thread stacks, affinity and scheduling
+
 // Usings
 using namespace std; // Cleans up code syntax a bit
 
@@ -41,6 +61,8 @@ using namespace std; // Cleans up code syntax a bit
 #define MAX_CAT_SLEEP         3 // Max sleep time for cats in seconds
 #define MAX_LIZARD_EAT        5 // Max time lizards spend eating in seconds
 #define CROSS_SECONDS         2 // Time taken by a lizard to cross the driveway
+#define EMERGENCY_WEIGHT      4 // Gate weight of emergency lizards (normal lizards have 1)
+#define EMERGENCY_SPOTS       1 // Driveway spots reserved for emergency lizards
 
 // Classes/Enums
 enum Direction {
@@ -49,13 +71,19 @@ enum Direction {
   MONKEY_GRASS_TO_SAGO  // Lizards crossing from monkey grass to sago
 };
 
+enum Service {
+  NORMAL_SERVICE,   // Shares the driveway with everyone
+  EMERGENCY_SERVICE // Has reserved spots and a higher gate weight (-e)
+};
+
 /**
  * This class models a cat that sleep, wakes-up, checks on lizards in the driveway
  * and goes back to sleep. If the cat sees enough lizards it "plays" with them.
  */
 class Cat {
-	int     _id;   // Unique ID for each cat
-	thread* _aCat; // Pointer to the cat's thread
+	int    _id;   // Unique ID for each cat
+	WorldThread _aCat; // The cat's thread, owned by value
+	Rng    _rng;  // The cat's own random numbers, for sampling times
 	
 	public:
 		Cat(int id); // Constructor that initializes the cat's ID
@@ -65,6 +93,7 @@ class Cat {
     
   private:
 		void sleepNow();                   // Simulates the cat sleeping for a random time
+		void inspect();                    // Samples the driveway until the world ends
     static void catThread (Cat *aCat); // Thread function for the cat
 };
 
@@ -73,11 +102,16 @@ class Cat {
  * eating, and returning back to the initial point to sleep.
  */
 class Lizard {
-	int     _id;      // Unique ID for each lizard
-	thread* _aLizard; // Pointer to the lizard's thread
+	int                  _id;        // Unique ID for each lizard
+	WorldThread          _aLizard;   // The lizard's thread, owned by value
+	uint64_t             _waitStart; // When the lizard started waiting at the gate
+	const BehaviorClass *_behavior;  // How this lizard sleeps, eats and crosses
+	Rng                  _rng;       // The lizard's own random number generator
+	Service              _service;   // Service class at the driveway gate
+	int                  _slot;      // Direction bias slot held while crossing, or -1
 	
   public:
-		Lizard(int id); // Constructor that initializes the lizard's ID
+		Lizard(int id, const BehaviorClass *behavior); // Constructor that initializes the lizard's ID
 		int getId();    // Getter for the lizard's ID
     void run();     // Starts the lizard's thread
     void wait();    // Waits for the lizard's thread to complete
@@ -91,21 +125,258 @@ class Lizard {
 		void crossMonkeyGrass2Sago();  // Crosses the driveway from monkey grass to sago
 		void madeIt2Sago();            // Completes crossing to sago and releases a driveway spot
 		void sleepNow();               // Simulates the lizard sleeping
+		bool returnsByDriveway();      // Decides whether to cross back or walk around (-x)
+		void walkAround();             // Walks back to the sago the long way around
+		void crossDriveway(uint32_t direction);                // Spends the crossing time on the driveway
+		void logCrossing(uint32_t direction, uint64_t enter); // Records a finished crossing
     static void lizardThread(Lizard *aLizard); // Thread function for the lizard
+    static void loadThread(Lizard *aLizard);   // Thread function serving load requests (-g)
+};
+
+/**
+ * A lizard parked at the direction gate. Lives on the waiting lizard's
+ * stack and is linked into the queue of the direction it wants to go.
+ */
+struct GateWaiter {
+  sem_t       admitted; // Posted once the gate has admitted this lizard
+  uint32_t    lizard;   // Id of the waiting lizard, for the occupancy map
+  bool        urgent;   // Waiter has emergency service
+  GateWaiter* next;     // Next lizard waiting for the same direction
+};
+
+/**
+ * FIFO of lizards waiting for one direction.
+ */
+struct GateQueue {
+  GateWaiter* head;
+  GateWaiter* tail;
+  int         urgent; // Emergency lizards in the queue
 };
 
 // Synchronization Globals
 Direction currentDirection = NONE; // Tracks the current crossing direction of lizards
-condition_variable direction_CV;   // Condition variable for direction control
+GateQueue directionQueue[3];       // Waiting lizards, indexed by Direction
 mutex direction_mutex;             // Mutex for direction control
+DirectionBias directionBias;       // Lets the favored direction skip direction_mutex (-b)
 mutex cout_mutex;                  // Mutex to control access to standard output
-sem_t driveway_sem;                // Semaphore to limit the number of lizards on the driveway
+DebugLog &debugLog = *new DebugLog; // Buffered debug output (-d); never destroyed, see logger.h
+ClassGate drivewayGate(MAX_LIZARD_CROSSING); // Limits the lizards on the driveway per service class
+PipelinedDriveway driveway;        // Cell by cell driveway (-k)
+CatInspector inspector;            // Sampling cats (-s)
+CrossingLog crossingLog;           // Binary log of every crossing (-l)
+OccupancyMap occupancy;            // Which lizards are on the driveway
+LoadGenerator loadGenerator;       // Open-loop crossing requests (-g)
+BehaviorMix behaviorMix(MAX_LIZARD_SLEEP, MAX_LIZARD_EAT); // Behavior classes of the population (-m)
+WorldSweep worldSweep;             // Results of a forked sweep of worlds (-f)
+ThreadLayout threadLayout;         // Stack, affinity and scheduling of threads
 
 // Global Variables
-int numCrossingSago2MonkeyGrass = 0; // Count of lizards crossing from sago to monkey grass
-int numCrossingMonkeyGrass2Sago = 0; // Count of lizards crossing from monkey grass to sago
+CrossingCounters numCrossing;        // Lizards crossing each way, packed into one atomic word
 int debug   = 0;                     // Debug mode flag
 int running = 1;                     // Flag to keep the simulation running
+int worldSeconds = WORLDEND;         // Seconds each world is simulated (-t)
+int numLizards = NUM_LIZARDS;        // Lizards per world (-n)
+int numEmergency = 0;                // Lizards with emergency service (-e)
+int numCats = NUM_CATS;              // Cats per world (-c)
+int drivewayCapacity = MAX_LIZARD_CROSSING; // Lizards allowed on the driveway (cells with -k)
+double returnChance = 1.0;           // Chance a lizard crosses back rather than walking around (-x)
+int profiling = 0;                   // Sample lizard phases (--profile, needs PROFILE=1)
+
+// Direction Gate Functions
+
+/**
+ * Returns the counter index of a direction.
+ *
+ * @param direction - Either crossing direction.
+ * @return 0 for sago to monkey grass, 1 for monkey grass to sago.
+ */
+int way(Direction direction) {
+  return direction == SAGO_TO_MONKEY_GRASS ? 0 : 1;
+}
+
+/**
+ * Returns the direction opposite to the given one.
+ */
+Direction opposite(Direction direction) {
+  return direction == SAGO_TO_MONKEY_GRASS ? MONKEY_GRASS_TO_SAGO : SAGO_TO_MONKEY_GRASS;
+}
+
+/**
+ * Flips the gate if the last lizard going the given direction is off the
+ * driveway: to the other side if lizards wait there, else back to this
+ * side's waiters, else to NONE. Up to drivewayCapacity waiting lizards
+ * are detached as a convoy, counted as crossing and marked as on the
+ * driveway. Call with direction_mutex held.
+ *
+ * @return The admitted waiters, to be woken once the mutex is released.
+ */
+GateWaiter* flipIfEmpty(Direction direction) {
+  // Lizards are still crossing this way, or the bias still lets them on
+  if(currentDirection != direction || directionBias.isBiased() ||
+     numCrossing.snapshot()[way(direction)] > 0 || !directionBias.drained()) {
+    return nullptr;
+  }
+
+  // Flip to whichever side has lizards waiting, preferring the other side
+  Direction next = opposite(direction);
+  if(!directionQueue[next].head) {
+    next = direction;
+  }
+  GateQueue& queue = directionQueue[next];
+  if(!queue.head) {
+    currentDirection = NONE;
+    return nullptr;
+  }
+
+  // Detach a convoy of waiters and count them as crossing
+  currentDirection = next;
+  GateWaiter* convoy = queue.head;
+  GateWaiter* last = convoy;
+  numCrossing.enter(way(next));
+  occupancy.enter(way(next), last->lizard);
+  queue.urgent -= last->urgent;
+  int admitted = 1;
+  for(; admitted < drivewayCapacity && last->next; admitted++) {
+    last = last->next;
+    numCrossing.enter(way(next));
+    occupancy.enter(way(next), last->lizard);
+    queue.urgent -= last->urgent;
+  }
+  directionBias.countSlow(admitted);
+  queue.head = last->next;
+  if(!queue.head) {
+    queue.tail = nullptr;
+  }
+  last->next = nullptr;
+  return convoy;
+}
+
+/**
+ * Wakes exactly the admitted lizards, outside the mutex. Reads next
+ * before posting, since a woken lizard's waiter goes away with its stack
+ * frame.
+ */
+void wakeConvoy(GateWaiter* convoy) {
+  while(convoy) {
+    GateWaiter* next = convoy->next;
+    sem_post(&convoy->admitted);
+    convoy = next;
+  }
+}
+
+/**
+ * Blocks until the gate lets the caller cross in the given direction,
+ * then counts the caller as crossing that way and marks it as on the
+ * driveway, in the same place, so a report never finds it counted but
+ * missing from the occupancy map.
+ *
+ * With the bias on (-b) a lizard going the favored way walks on through
+ * its own slot without taking the mutex. Otherwise, a lizard going the
+ * current way (or finding the driveway empty) enters immediately, unless
+ * an emergency lizard waits on the other side; then it queues too, so
+ * the driveway drains and flips for the emergency. Anyone else revokes
+ * the bias, queues up and sleeps on its own semaphore until a flip
+ * admits it, so a flip never wakes lizards it cannot let in.
+ *
+ * @param direction - Direction the lizard wants to cross.
+ * @param urgent    - The lizard has emergency service.
+ * @param lizard    - Id of the lizard, which picks its bias slot.
+ * @return The bias slot the lizard holds, or -1; pass it to leaveDirection.
+ */
+int enterDirection(Direction direction, bool urgent, uint32_t lizard) {
+  int slot = directionBias.tryEnter(way(direction), lizard);
+  if(slot >= 0) {
+    numCrossing.enter(way(direction));
+    occupancy.enter(way(direction), lizard);
+    return slot;
+  }
+
+  GateWaiter waiter;
+  GateWaiter* convoy;
+
+  {
+    PROFILED_LOCK_GUARD(lock, direction_mutex, PHASE_DIRECTION_MUTEX);
+
+    // Walk straight on if the driveway is empty or already going our way
+    if(currentDirection == NONE ||
+       (currentDirection == direction && !directionQueue[opposite(direction)].urgent)) {
+      currentDirection = direction;
+      numCrossing.enter(way(direction));
+      occupancy.enter(way(direction), lizard);
+      directionBias.countSlow(1);
+      if(!directionQueue[opposite(direction)].head) {
+        directionBias.favor(way(direction));
+      }
+      return -1;
+    }
+
+    // Otherwise get in line; the flip will count us as crossing
+    GateQueue& queue = directionQueue[direction];
+    sem_init(&waiter.admitted, 0, 0);
+    waiter.lizard = lizard;
+    waiter.urgent = urgent;
+    waiter.next = nullptr;
+    queue.urgent += urgent;
+    if(queue.tail) {
+      queue.tail->next = &waiter;
+    } else {
+      queue.head = &waiter;
+    }
+    queue.tail = &waiter;
+
+    // Stop favoring the other way; if its lizards are all off already,
+    // nobody else is left to flip the gate
+    directionBias.revoke();
+    convoy = flipIfEmpty(currentDirection);
+  }
+
+  wakeConvoy(convoy);
+
+  // Sleep without the mutex until a flip admits us
+  {
+    PROFILE_PHASE(PHASE_DIRECTION_WAIT);
+    sem_wait(&waiter.admitted);
+  }
+  sem_destroy(&waiter.admitted);
+  return -1;
+}
+
+/**
+ * Takes the caller off the occupancy map and counts it as having left
+ * the driveway. When the last lizard of a direction leaves, the gate
+ * flips to the other direction and admits up to drivewayCapacity of its
+ * waiting lizards in one batch.
+ *
+ * @param direction - Direction the lizard was crossing.
+ * @param slot      - What enterDirection returned.
+ * @param lizard    - Id of the lizard.
+ */
+void leaveDirection(Direction direction, int slot, uint32_t lizard) {
+  GateWaiter* convoy;
+
+  // Off the map before the counter drops, like lizards.cpp
+  occupancy.leave(way(direction), lizard);
+
+  // Through a bias slot: nothing can be waiting unless the bias was revoked
+  if(slot >= 0) {
+    numCrossing.leave(way(direction));
+    if(!directionBias.leave(slot, way(direction))) {
+      return;
+    }
+  }
+
+  {
+    PROFILED_LOCK_GUARD(lock, direction_mutex, PHASE_DIRECTION_MUTEX);
+
+    // Others are still crossing this way; nothing changes
+    if(slot < 0 && numCrossing.leaveAndRead(way(direction))[way(direction)] > 0) {
+      return;
+    }
+    convoy = flipIfEmpty(direction);
+  }
+
+  wakeConvoy(convoy);
+}
 
 // Cat Class Methods
 
@@ -116,6 +387,7 @@ int running = 1;                     // Flag to keep the simulation running
  */
 Cat::Cat (int id) {
 	_id = id;
+  _rng.reseed(random());
 }
 
 /**
@@ -131,8 +403,9 @@ int Cat::getId() {
  * Launches a cat thread if it hasn't been started.
  */
 void Cat::run() {
-  if(!_aCat) {
-    _aCat = new thread(catThread, this);
+  if(!_aCat.joinable() && !_aCat.start([this] { catThread(this); }, numLizards + _id, true)) {
+    cerr << "cannot start cat " << _id << endl;
+    exit(1);
   }
 }
 
@@ -140,8 +413,8 @@ void Cat::run() {
  * Waits for the cat thread to complete execution.
  */
 void Cat::wait() {
-  if(_aCat && _aCat->joinable()) {
-    _aCat->join();
+  if(_aCat.joinable()) {
+    _aCat.join();
   }
 }
 
@@ -152,17 +425,13 @@ void Cat::sleepNow() {
 	int sleepSeconds = 1 + (int)(random() / (double)RAND_MAX * MAX_CAT_SLEEP);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << _id << "] cat sleeping for " << sleepSeconds << " seconds" << endl;
-		cout << flush;
+    debugLog.line("[%d] cat sleeping for %d seconds", _id, sleepSeconds);
   }
 
 	sleep(sleepSeconds);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << _id << "] cat awake" << endl;
-		cout << flush;
+    debugLog.line("[%d] cat awake", _id);
   }
 }
 
@@ -174,33 +443,59 @@ void Cat::sleepNow() {
  */
 void Cat::catThread(Cat *aCat) {
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << aCat->getId() << "] cat is alive\n";
-		cout << flush;
+    debugLog.line("[%d] cat is alive", aCat->getId());
+  }
+
+  // Inspecting cats sample at their own rate and never abort
+  if(inspector.isOn()) {
+    aCat->inspect();
+    return;
   }
 
 	while(running) {
 		aCat->sleepNow();
 
 		// Check if too many lizards are on the driveway
-    int totalCrossing = numCrossingSago2MonkeyGrass + numCrossingMonkeyGrass2Sago; // NN DS
-		if(totalCrossing > MAX_LIZARD_CROSSING) {
-      lock_guard<mutex> lock(cout_mutex);
+    int totalCrossing = numCrossing.snapshot().total(); // NN DS
+		if(totalCrossing > drivewayCapacity) {
+      PROFILED_LOCK_GUARD(lock, cout_mutex, PHASE_COUT_MUTEX);
+		  debugLog.finalFlush();
 		  cout << "\tThe cats are happy - they have toys.\n";
+      cout << "\t" << occupancy.snapshot().describe() << endl;
+      worldSweep.violation("The cats are happy - they have toys.");
       exit(-1);
 		}
   }
 }
 
+/**
+ * Samples the crossing counters at the inspection rate until the world
+ * ends, then adds what the cat saw to the inspector's totals.
+ */
+void Cat::inspect() {
+  InspectionWindow window(inspector.windowMicros());
+
+  while(running) {
+    sleepFor(inspector.nextInterval(_rng));
+    inspector.sample(window, numCrossing.snapshot(), drivewayCapacity, UNIDIRECTIONAL);
+  }
+  inspector.merge(window);
+}
+
 // Lizard Class Methods
 
 /**
  * Constructs a lizard with a unique ID.
  *
- * @param id - Unique ID for the lizard.
+ * @param id       - Unique ID for the lizard.
+ * @param behavior - Behavior class the lizard belongs to.
  */
-Lizard::Lizard(int id) {
+Lizard::Lizard(int id, const BehaviorClass *behavior) {
 	_id = id;
+  _behavior = behavior;
+  _rng.reseed(random());
+  _service = id < numEmergency ? EMERGENCY_SERVICE : NORMAL_SERVICE;
+  _slot = -1;
 }
 
 /**
@@ -216,8 +511,10 @@ int Lizard::getId() {
  * Launches a lizard thread if it hasn't been started.
  */
 void Lizard::run() {
-  if(!_aLizard) {
-    _aLizard = new thread(lizardThread, this);
+  void (*body)(Lizard *) = loadGenerator.isOn() ? loadThread : lizardThread;
+  if(!_aLizard.joinable() && !_aLizard.start([this, body] { body(this); }, _id, false)) {
+    cerr << "cannot start lizard " << _id << endl;
+    exit(1);
   }
 }
  
@@ -225,8 +522,8 @@ void Lizard::run() {
  * Waits for the lizard thread to complete execution.
  */
 void Lizard::wait() {
-	if(_aLizard && _aLizard->joinable()) {
-    _aLizard->join();
+	if(_aLizard.joinable()) {
+    _aLizard.join();
   } 
 }
 
@@ -234,21 +531,42 @@ void Lizard::wait() {
  * Simulates a lizard sleeping for a random amount of time.
  */
 void Lizard::sleepNow() {
-	int sleepSeconds = 1 + (int)(random() / (double)RAND_MAX * MAX_LIZARD_SLEEP);
+  PROFILE_PHASE(PHASE_SLEEP);
+
+	double sleepSeconds = drawDuration(_behavior->sleep, _rng);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-    cout << "[" << _id << "] sleeping for " << sleepSeconds << " seconds" << endl;
-    cout << flush;
+    debugLog.line("[%d] sleeping for %g seconds", _id, sleepSeconds);
   }
 
-	sleep(sleepSeconds);
+	sleepFor(sleepSeconds);
+
+	if(debug) {
+    debugLog.line("[%d] awake", _id);
+  }
+}
+
+/**
+ * Decides whether the lizard crosses the driveway back to the sago. With
+ * skewed traffic (-x) some lizards walk back around the house instead,
+ * so most crossings go sago -> monkey grass.
+ *
+ * @return true if the lizard takes the driveway.
+ */
+bool Lizard::returnsByDriveway() {
+  return returnChance >= 1.0 || _rng.uniform() < returnChance;
+}
 
+/**
+ * Walks back to the sago the long way around, which takes as long as a
+ * crossing but never touches the driveway.
+ */
+void Lizard::walkAround() {
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-    cout << "[" << _id << "] awake" << endl;
-    cout << flush;
+    debugLog.line("[%d] walking around to the sago", _id);
   }
+
+  sleepFor(CROSS_SECONDS * _behavior->crossScale);
 }
 
 /**
@@ -256,37 +574,26 @@ void Lizard::sleepNow() {
  * to the monkey grass.
  */
 void Lizard::sago2MonkeyGrassIsSafe() {
+  PROFILE_PHASE(PHASE_SAGO_SAFE);
+
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << _id << "] checking sago -> monkey grass" << endl;
-		cout << flush;
+    debugLog.line("[%d] checking sago -> monkey grass", _id);
   }
 
-  // Wait for a spot on the driveway if at max capacity
-  sem_wait(&driveway_sem);
-
-  // Lock the direction for crossing
-  unique_lock<mutex> lock(direction_mutex);
+  // Start the clock on the gate wait
+  _waitStart = monotonicMicros();
 
-  // Wait until no lizards are crossing in the opposite direction
-  direction_CV.wait(lock, [] {
-    return (currentDirection == SAGO_TO_MONKEY_GRASS && 
-            numCrossingMonkeyGrass2Sago == 0) || 
-            currentDirection == NONE;
-  });
-
-  // Set the direction for crossing if it is not already set
-  if(currentDirection == NONE) {
-    currentDirection = SAGO_TO_MONKEY_GRASS;
+  // Wait for a spot on the driveway if at max capacity
+  {
+    PROFILE_PHASE(PHASE_SEM_WAIT);
+    drivewayGate.enter(_service);
   }
 
-  // Claim intent to start crossing
-  numCrossingSago2MonkeyGrass++;
+  // Wait until the gate lets us go this way; this claims our crossing
+  _slot = enterDirection(SAGO_TO_MONKEY_GRASS, _service == EMERGENCY_SERVICE, (uint32_t)_id);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << _id << "] thinks sago -> monkey grass is safe" << endl;
-		cout << flush;
+    debugLog.line("[%d] thinks sago -> monkey grass is safe", _id);
   }
 }
 
@@ -295,59 +602,52 @@ void Lizard::sago2MonkeyGrassIsSafe() {
  * from the sago to the monkey grass.
  */
 void Lizard::crossSago2MonkeyGrass() {
+  PROFILE_PHASE(PHASE_CROSS_SAGO);
+  uint64_t enter = monotonicMicros(); // Stepped onto the driveway
+
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-    cout << "[" << _id << "] crossing  sago -> monkey grass" << endl;
-    cout << flush;
+    debugLog.line("[%d] crossing  sago -> monkey grass", _id);
   }
 
-  {
-    lock_guard<mutex> lock(direction_mutex);
-
-    // Check for crossing conflicts
-    if(numCrossingMonkeyGrass2Sago > 0 && UNIDIRECTIONAL) {
-      cout << "\tCrash!  We have a pile-up on the concrete." << endl;
-      cout << "\t" << numCrossingSago2MonkeyGrass << " crossing sago -> monkey grass" << endl;
-      cout << "\t" << numCrossingMonkeyGrass2Sago << " crossing monkey grass -> sago" << endl;
-      exit(-1);
-    }
+  // Check for crossing conflicts against one lock-free snapshot
+  CrossingSnapshot crossing = numCrossing.snapshot();
+  if(crossing[1] > 0 && UNIDIRECTIONAL) {
+    debugLog.finalFlush();
+    cout << "\tCrash!  We have a pile-up on the concrete." << endl;
+    cout << "\t" << crossing.sago2MonkeyGrass << " crossing sago -> monkey grass" << endl;
+    cout << "\t" << crossing.monkeyGrass2Sago << " crossing monkey grass -> sago" << endl;
+    cout << "\t" << occupancy.snapshot().describe() << endl;
+    worldSweep.violation("Crash!  We have a pile-up on the concrete.");
+    exit(-1);
   }
 
   // NN DS
   if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << numCrossingSago2MonkeyGrass << " crossing sago -> monkey grass" << endl;
-    cout << flush;
+    debugLog.line("%d crossing sago -> monkey grass", crossing[0]);
   }
 
 	// Simulate the time taken to cross the driveway
-	sleep(CROSS_SECONDS);
+	crossDriveway(0);
 
-  // Mark crossing completion and update counters
-  {
-    lock_guard<mutex> lock(direction_mutex);
-    numCrossingSago2MonkeyGrass--;
+  // Mark crossing completion; the last one out flips the gate
+  leaveDirection(SAGO_TO_MONKEY_GRASS, _slot, (uint32_t)_id);
 
-    // If no lizards are left in this direction, release the direction lock
-    if(numCrossingSago2MonkeyGrass == 0) {
-      currentDirection = NONE;
-      direction_CV.notify_all();
-    }
-  }
+  // Record the finished crossing
+  logCrossing(0, enter);
 }
 
 /**
  * Signals that the lizard has safely crossed to the monkey grass side.
- * Releases one spot on the driveway semaphore.
+ * Releases one spot on the driveway gate.
  */
 void Lizard::madeIt2MonkeyGrass() {
+  PROFILE_PHASE(PHASE_MADE_IT_GRASS);
+
 	// Release driveway spot
-  sem_post(&driveway_sem);
+  drivewayGate.leave(_service);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << _id << "] made the sago -> monkey grass crossing" << endl;
-		cout << flush;
+    debugLog.line("[%d] made the sago -> monkey grass crossing", _id);
   }
 }
 
@@ -355,20 +655,18 @@ void Lizard::madeIt2MonkeyGrass() {
  * Simulates the lizard eating for a random amount of time after crossing.
  */
 void Lizard::eat() {
-	int eatSeconds = 1 + (int)(random() / (double)RAND_MAX * MAX_LIZARD_EAT);
+  PROFILE_PHASE(PHASE_EAT);
+
+	double eatSeconds = drawDuration(_behavior->eat, _rng);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << _id << "] eating for " << eatSeconds << " seconds" << endl;
-		cout << flush;
+    debugLog.line("[%d] eating for %g seconds", _id, eatSeconds);
   }
 
-	sleep(eatSeconds);
+	sleepFor(eatSeconds);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-    cout << "[" << _id << "] finished eating" << endl;
-    cout << flush;
+    debugLog.line("[%d] finished eating", _id);
   }
 }
 
@@ -377,37 +675,26 @@ void Lizard::eat() {
  * back to the sago.
  */
 void Lizard::monkeyGrass2SagoIsSafe() {
+  PROFILE_PHASE(PHASE_GRASS_SAFE);
+
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << _id << "] checking monkey grass -> sago" << endl;
-		cout << flush;
+    debugLog.line("[%d] checking monkey grass -> sago", _id);
   }
 
-  // Wait for a spot on the driveway if at max capacity
-  sem_wait(&driveway_sem);
-
-  // Lock the direction for crossing
-  unique_lock<mutex> lock(direction_mutex);
-
-  // Wait until no lizards are crossing in the opposite direction
-  direction_CV.wait(lock, [] {
-    return (currentDirection == MONKEY_GRASS_TO_SAGO &&
-            numCrossingSago2MonkeyGrass == 0) ||
-            currentDirection == NONE;
-  });
+  // Start the clock on the gate wait
+  _waitStart = monotonicMicros();
 
-  // Set the direction for crossing if it is not already set
-  if(currentDirection == NONE) {
-    currentDirection = MONKEY_GRASS_TO_SAGO;
+  // Wait for a spot on the driveway if at max capacity
+  {
+    PROFILE_PHASE(PHASE_SEM_WAIT);
+    drivewayGate.enter(_service);
   }
 
-  // Claim intent to start crossing
-  numCrossingMonkeyGrass2Sago++;
+  // Wait until the gate lets us go this way; this claims our crossing
+  _slot = enterDirection(MONKEY_GRASS_TO_SAGO, _service == EMERGENCY_SERVICE, (uint32_t)_id);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << _id << "] thinks monkey grass -> sago is safe" << endl;
-		cout << flush;
+    debugLog.line("[%d] thinks monkey grass -> sago is safe", _id);
   }
 }
 
@@ -415,57 +702,97 @@ void Lizard::monkeyGrass2SagoIsSafe() {
  * Simulates the lizard crossing the driveway back to the sago.
  */
 void Lizard::crossMonkeyGrass2Sago() {
+  PROFILE_PHASE(PHASE_CROSS_GRASS);
+  uint64_t enter = monotonicMicros(); // Stepped onto the driveway
+
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << _id << "] crossing monkey grass -> sago" << endl;
-		cout << flush;
+    debugLog.line("[%d] crossing monkey grass -> sago", _id);
   }
 
-  {
-    lock_guard<mutex> lock(direction_mutex);
-
-    // Check for crossing conflicts
-    if(numCrossingSago2MonkeyGrass > 0 && UNIDIRECTIONAL) {
-      cout << "\tOh No!, the lizards have cats all over them." << endl;
-      cout << "\t " << numCrossingSago2MonkeyGrass << " crossing sago -> monkey grass" << endl;
-      cout << "\t " << numCrossingMonkeyGrass2Sago << " crossing monkey grass -> sago" << endl;
-      exit(-1);
-    }
+  // Check for crossing conflicts against one lock-free snapshot
+  CrossingSnapshot crossing = numCrossing.snapshot();
+  if(crossing[0] > 0 && UNIDIRECTIONAL) {
+    debugLog.finalFlush();
+    cout << "\tOh No!, the lizards have cats all over them." << endl;
+    cout << "\t " << crossing.sago2MonkeyGrass << " crossing sago -> monkey grass" << endl;
+    cout << "\t " << crossing.monkeyGrass2Sago << " crossing monkey grass -> sago" << endl;
+    cout << "\t " << occupancy.snapshot().describe() << endl;
+    worldSweep.violation("Oh No!, the lizards have cats all over them.");
+    exit(-1);
   }
 
   if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << numCrossingMonkeyGrass2Sago << " crossing monkey grass -> sago" << endl;
-    cout << flush;
+    debugLog.line("%d crossing monkey grass -> sago", crossing[1]);
   }
 
-	sleep(CROSS_SECONDS);
+	crossDriveway(1);
 
-	// Mark crossing completion and update counters
-  {
-    lock_guard<mutex> lock(direction_mutex);
-    numCrossingMonkeyGrass2Sago--;
+  // Mark crossing completion; the last one out flips the gate
+  leaveDirection(MONKEY_GRASS_TO_SAGO, _slot, (uint32_t)_id);
 
-    // If no lizards are left in this direction, release the direction lock
-    if(numCrossingMonkeyGrass2Sago == 0) {
-      currentDirection = NONE;
-      direction_CV.notify_all();
-    }
-  }
+  // Record the finished crossing
+  logCrossing(1, enter);
 }
 
 /**
  * Signals tha the lizard has safely crossed back to the sago side,
- * releasing a spot on the driveway semaphore.
+ * releasing a spot on the driveway gate.
  */
 void Lizard::madeIt2Sago() {
+  PROFILE_PHASE(PHASE_MADE_IT_SAGO);
+
   // Release driveway spot
-  sem_post(&driveway_sem);
+  drivewayGate.leave(_service);
 
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-		cout << "[" << _id << "] made the monkey grass -> sago crossing" << endl;
-		cout << flush;
+    debugLog.line("[%d] made the monkey grass -> sago crossing", _id);
+  }
+}
+
+/**
+ * Spends the crossing time on the driveway: one sleep, or a walk across
+ * the cells of the pipelined driveway (-k). Meeting a lizard head-on in a
+ * cell is a pile-up.
+ *
+ * @param direction - 0 for sago to monkey grass, 1 for the way back.
+ */
+void Lizard::crossDriveway(uint32_t direction) {
+  double seconds = CROSS_SECONDS * _behavior->crossScale;
+  uint32_t conflict;
+
+  if(!driveway.isOn()) {
+    sleepFor(seconds);
+    return;
+  }
+  if(!driveway.cross((uint32_t)_id, direction, seconds, conflict)) {
+    debugLog.finalFlush();
+    cout << "\tCrash!  Lizards " << _id << " and " << PipelinedDriveway::lizardOf(conflict)
+         << " met head-on on the driveway." << endl;
+    worldSweep.violation("Crash!  Lizards met head-on in a driveway cell.");
+    exit(-1);
+  }
+}
+
+/**
+ * Counts one finished crossing towards the lizard's behavior class,
+ * service class and the current sweep world, and appends it to the
+ * crossing log, if logging is on.
+ *
+ * @param direction - 0 for sago to monkey grass, 1 for the way back.
+ * @param enter     - monotonicMicros() when the lizard entered the driveway.
+ */
+void Lizard::logCrossing(uint32_t direction, uint64_t enter) {
+  uint64_t wait = enter - _waitStart;
+
+  behaviorMix.countCrossing(_behavior, wait);
+  drivewayGate.countWait(_service, wait);
+  worldSweep.crossing((uint32_t)_id, direction, enter, wait);
+  if(crossingLog.isOpen()) {
+    CrossingRecord crossing = {
+      (uint32_t)_id, direction, crossingLog.since(enter),
+      crossingLog.since(monotonicMicros()), wait
+    };
+    crossingLog.record(crossing);
   }
 }
 
@@ -478,9 +805,7 @@ void Lizard::madeIt2Sago() {
   */
 void Lizard::lizardThread(Lizard *aLizard) {
 	if(debug) {
-    lock_guard<mutex> lock(cout_mutex);
-    cout << "[" << aLizard->getId() << "] lizard is alive" << endl;
-    cout << flush;
+    debugLog.line("[%d] lizard is alive", aLizard->getId());
   }
 
 	while(running) {
@@ -489,83 +814,329 @@ void Lizard::lizardThread(Lizard *aLizard) {
     aLizard->crossSago2MonkeyGrass();
     aLizard->madeIt2MonkeyGrass();
     aLizard->eat();
-    aLizard->monkeyGrass2SagoIsSafe();
-    aLizard->crossMonkeyGrass2Sago();
-    aLizard->madeIt2Sago();
+    if(aLizard->returnsByDriveway()) {
+      aLizard->monkeyGrass2SagoIsSafe();
+      aLizard->crossMonkeyGrass2Sago();
+      aLizard->madeIt2Sago();
+    } else {
+      aLizard->walkAround();
+    }
   }
 }
 
-// Main
-
 /**
- * Initializes and runs the simulation, creates all lizard and cat threads,
- * and manages cleanup.
+ * Serves crossing requests of the load generator (-g) instead of
+ * sleeping and eating: waits for a request, crosses the way it asks
+ * and reports back, until the world ends.
+ *
+ * @param aLizard - Pointer to the lizard thread.
  */
-int main(int argc, char **argv) {
-	// Check for the debugging flag (-d)
-	if(argc > 1) {
-		if(strncmp(argv[1], "-d", 2) == 0) {
-			debug = 1;
+void Lizard::loadThread(Lizard *aLizard) {
+  CrossingRequest request;
+
+  while(loadGenerator.take(request)) {
+    uint64_t entered;
+    if(request.direction == 0) {
+      aLizard->sago2MonkeyGrassIsSafe();
+      entered = monotonicMicros();
+      aLizard->crossSago2MonkeyGrass();
+      aLizard->madeIt2MonkeyGrass();
+    } else {
+      aLizard->monkeyGrass2SagoIsSafe();
+      entered = monotonicMicros();
+      aLizard->crossMonkeyGrass2Sago();
+      aLizard->madeIt2Sago();
     }
+    loadGenerator.completed(request, entered);
   }
+}
 
-	// Declare thread vectors
-  vector<Lizard*> allLizards;
-  vector<Cat*>    allCats;
-
-	// Initialize random number generator
-	srandom((unsigned int)time(NULL));
+// Main
 
-	// Initialize semaphore to control max number of lizards on the driveway
-  sem_init(&driveway_sem, 0, MAX_LIZARD_CROSSING);
+/**
+ * Builds one world out of the given pools, runs it for worldSeconds and
+ * tears it down. The pools are cleared but keep their capacity, so
+ * rebuilding a world does not allocate again.
+ *
+ * @param allLizards - Contiguous storage for the lizards of this world.
+ * @param allCats    - Contiguous storage for the cats of this world.
+ */
+void runWorld(vector<Lizard>& allLizards, vector<Cat>& allCats) {
+  // Reset the shared state left behind by a previous world
+  numCrossing.reset();
+  occupancy.reset(numLizards);
+  currentDirection = NONE;
+  directionBias.reset();
+  running = 1;
+  if(debug) {
+    debugLog.start();
+  }
 
-	// Create all lizard and cat threads and store in vectors
-  for(int i = 0; i < NUM_LIZARDS; i++) {
-    allLizards.push_back(new Lizard(i));
+	// Empty the driveway gate that controls max number of lizards on it
+  drivewayGate.reset();
+  driveway.clear();
+  threadLayout.prepare(numLizards + numCats);
+
+	// Construct all lizards and cats in place; threads hold a pointer to
+  // their object, so the pools must not grow once threads are running
+  allLizards.clear();
+  allLizards.reserve(numLizards);
+  for(int i = 0; i < numLizards; i++) {
+    allLizards.emplace_back(i, behaviorMix.classFor(i, numLizards));
   }
-	for(int i = 0; i < NUM_CATS; i++) {
-    allCats.push_back(new Cat(i));
+  allCats.clear();
+  allCats.reserve(numCats);
+	for(int i = 0; i < numCats; i++) {
+    allCats.emplace_back(i);
   }
 
 	// Run all lizard and cat threads
   for(auto& lizard : allLizards) {
-    lizard->run();
+    lizard.run();
   }
   for(auto& cat : allCats) {
-    cat->run();
+    cat.run();
   }
 
-	// Now let the world run for a while
-	sleep(WORLDEND);
+	// Now let the world run for a while, feeding it requests with -g
+  if(loadGenerator.isOn()) {
+    loadGenerator.generate(worldSeconds);
+    loadGenerator.close();
+  } else {
+    sleep(worldSeconds);
+  }
+  threadLayout.sampleMemory();
 
   // That's it - the end of the world
 	running = 0;
 
   // Wait until all lizard and cat threads terminate
   for(auto& lizard : allLizards) {
-    lizard->wait();
+    lizard.wait();
   }
   for(auto& cat : allCats) {
-    cat->wait();
+    cat.wait();
   }
+  debugLog.stop();
+}
 
-  // Delete all lizard and cat objects
-  for(auto& lizard : allLizards) {
-    delete lizard;
+/**
+ * Initializes and runs the simulation, creates all lizard and cat threads,
+ * and manages cleanup.
+ *
+ * Options:
+ *   -d     Enable debugging output.
+ *   -o P   What a thread does when its debug lines outrun the writer:
+ *          "block" (the default) waits, "drop" throws lines away,
+ *          "count" throws them away and later prints how many.
+ *   -n N   Put N lizards in each world instead of NUM_LIZARDS.
+ *   -e N   Give the first N lizards emergency service at the gate.
+ *   -c N   Put N cats in each world instead of NUM_CATS.
+ *   -s R   Have every cat sample the driveway R times per second and
+ *          report how often it is in violation instead of aborting.
+ *   -k N   Cut the driveway into N cells that lizards cross one at a
+ *          time; the driveway then holds N lizards.
+ *   -r N   Rebuild and run the world N times in this process.
+ *   -f N   Run the -r worlds in N forked workers instead; a crashing
+ *          world only ends its own worker and the sweep goes on.
+ *   -t N   Simulate each world for N seconds instead of WORLDEND.
+ *   -l F   Log every crossing to F (read it back with crosslogdump).
+ *   -m M   Mix of lizard behavior classes, e.g. "uniform=80,bursty=20".
+ *   -b     Bias the direction gate towards the way it is going, so
+ *          lizards going that way skip direction_mutex.
+ *   -x P   Skew traffic so P percent of crossings go sago -> monkey
+ *          grass; the other lizards walk back around the house.
+ *   -g R   Drive the gate open-loop: instead of sleeping and eating,
+ *          the lizards serve crossing requests arriving at R per second,
+ *          one world per rate, e.g. "poisson:0.5,1,2" or "constant:1";
+ *          "auto" (or "auto:R" to start at R) doubles the rate until
+ *          the gate leaves over a tenth of the requests unserved, then
+ *          narrows down where it saturates.
+ *   -p, --profile
+ *          Print a per-phase profile at shutdown (build with PROFILE=1).
+ *   --stack KB
+ *          Give every lizard and cat thread a KB kilobyte stack.
+ *   --affinity L
+ *          Pin threads: "compact" onto neighboring CPUs, "scatter" round
+ *          robin across cores, "node" round robin over NUMA nodes.
+ *   --fifo-cats
+ *          Run the cats under SCHED_FIFO (needs CAP_SYS_NICE).
+ */
+int main(int argc, char **argv) {
+  int numWorlds = 1;  // Number of worlds to run back to back
+  int numWorkers = 0; // Worker processes of a sweep, 0 to stay in process
+  int opt;           // Current command-line option
+  static const struct option longOptions[] = {
+    {"profile", no_argument, NULL, 'p'},
+    {"stack", required_argument, NULL, 'S'},
+    {"affinity", required_argument, NULL, 'A'},
+    {"fifo-cats", no_argument, NULL, 'F'},
+    {NULL, 0, NULL, 0}
+  };
+
+	// Check for the debugging flag (-d) and world options
+  while((opt = getopt_long(argc, argv, "bc:de:f:g:k:l:m:n:o:pr:s:t:x:", longOptions, NULL)) != -1) {
+    switch(opt) {
+      case 'A':
+        if(!threadLayout.setAffinity(optarg)) {
+          cerr << "the affinity layout is compact, scatter or node" << endl;
+          return 1;
+        }
+        break;
+      case 'F': threadLayout.enableFifoCats(); break;
+      case 'S':
+        if(!threadLayout.setStack(optarg)) {
+          cerr << "the stack size is a number of kilobytes" << endl;
+          return 1;
+        }
+        break;
+      case 'b': directionBias.enable(); break;
+      case 'c': numCats = atoi(optarg); break;
+      case 'd': debug = 1; break;
+      case 'e': numEmergency = atoi(optarg); break;
+      case 'f': numWorkers = atoi(optarg); break;
+      case 'g':
+        if(!loadGenerator.parse(optarg)) {
+          cerr << "bad load '" << optarg << "'; rates are [poisson:|constant:]rate,rate,... or [poisson:|constant:]auto[:rate]" << endl;
+          return 1;
+        }
+        break;
+      case 'k':
+        if(atoi(optarg) < 1 || atoi(optarg) > MAX_DRIVEWAY_CELLS) {
+          cerr << "the driveway needs 1 to " << MAX_DRIVEWAY_CELLS << " cells" << endl;
+          return 1;
+        }
+        driveway.configure(atoi(optarg), 1);
+        break;
+      case 'l':
+        if(!crossingLog.open(optarg)) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      case 'm':
+        if(!behaviorMix.parse(optarg)) {
+          cerr << "bad behavior mix '" << optarg << "'; classes are " BEHAVIOR_NAMES << endl;
+          return 1;
+        }
+        break;
+      case 'n': numLizards = atoi(optarg); break;
+      case 'o':
+        if(!debugLog.setOverflow(optarg)) {
+          cerr << "the overflow policy is block, drop or count" << endl;
+          return 1;
+        }
+        break;
+      case 'p': profiling = 1; break;
+      case 'r': numWorlds = atoi(optarg); break;
+      case 's': inspector.configure(atof(optarg)); break;
+      case 't': worldSeconds = atoi(optarg); break;
+      case 'x':
+        if(atof(optarg) < 50 || atof(optarg) >= 100) {
+          cerr << "the skew is a percentage from 50 to below 100" << endl;
+          return 1;
+        }
+        returnChance = (100 - atof(optarg)) / atof(optarg);
+        loadGenerator.setSkew(atof(optarg) / 100);
+        break;
+      default:
+        cerr << "usage: " << argv[0] << " [-b] [-c cats] [-d] [-e emergency] [-f workers] [-g rates] [-k cells] [-l logfile]"
+             " [-m mix] [-n lizards] [-o overflow] [-p] [-r worlds] [-s rate] [-t seconds] [-x percent]"
+             " [--stack KB] [--affinity layout] [--fifo-cats]" << endl;
+        return 1;
+    }
   }
-  for(auto& cat : allCats) {
-    delete cat;
+
+  // The profiler only exists when it was compiled in
+  if(profiling && !PROFILE) {
+    cerr << "profiling is compiled out; rebuild with make PROFILE=1" << endl;
+    return 1;
+  }
+
+  // The log writer and profiler live in one process; a sweep has many
+  if(numWorkers > 0 && (crossingLog.isOpen() || profiling)) {
+    cerr << "-l and -p cannot be combined with -f" << endl;
+    return 1;
   }
 
-  // Destroy semaphore
-  sem_destroy(&driveway_sem);
+  // A load sweep runs one world per rate itself
+  if(loadGenerator.isOn() && (numWorkers > 0 || numWorlds != 1)) {
+    cerr << "-g cannot be combined with -f or -r" << endl;
+    return 1;
+  }
 
-  // Announce the end of the world
-  if(debug) {
-    cout << "world ended" << endl;
-    cout << flush;
+  // The sharded counters count up to 65535 lizards per direction
+  if(numLizards > CrossingCounters::MAX_LIZARDS) {
+    cerr << "at most " << CrossingCounters::MAX_LIZARDS << " lizards with these counters" << endl;
+    return 1;
+  }
+
+  // A pipelined driveway holds one lizard per cell; all lizards share the cells
+  if(driveway.isOn()) {
+    drivewayCapacity = driveway.capacity();
+    drivewayGate.setCapacity(drivewayCapacity);
+  }
+
+  // Emergency spots are taken out of the driveway; normal lizards need one left
+  if(numEmergency > 0 && EMERGENCY_SPOTS >= drivewayCapacity) {
+    cerr << "-e reserves " << EMERGENCY_SPOTS << " of the " << drivewayCapacity
+         << " driveway spots; normal lizards need at least one" << endl;
+    return 1;
+  }
+
+  // Normal lizards share the driveway; emergency ones get their own lane
+  drivewayGate.addClass("normal", 1, 0);
+  if(numEmergency > 0) {
+    drivewayGate.addClass("emergency", EMERGENCY_WEIGHT, EMERGENCY_SPOTS);
+  }
+
+	// Object pools reused by every world
+  vector<Lizard> allLizards;
+  vector<Cat>    allCats;
+
+	// Initialize random number generator
+	srandom((unsigned int)time(NULL));
+
+  // Hand the worlds to forked workers and report what each one did
+  if(numWorkers > 0) {
+    int crashed = worldSweep.run(numWorkers, numWorlds, (uint32_t)time(NULL),
+                                 [&] { runWorld(allLizards, allCats); });
+    return crashed == 0 ? 0 : 1;
+  }
+
+  // Run the requested number of worlds back to back, one per offered rate with -g
+  if(loadGenerator.isOn()) {
+    numWorlds = (int)loadGenerator.numRates();
+  }
+  for(int world = 0; world < numWorlds; world++) {
+    if(loadGenerator.isOn()) {
+      loadGenerator.select(world);
+    }
+    runWorld(allLizards, allCats);
+    threadLayout.countWorld(behaviorMix.totalCrossings());
+    if(loadGenerator.isOn()) {
+      loadGenerator.finishRate(worldSeconds);
+      numWorlds = (int)loadGenerator.numRates(); // An automatic sweep grows as it goes
+    }
+
+    // Announce the end of the world
+    if(debug) {
+      cout << "world ended" << endl;
+      cout << flush;
+    }
   }
+
+  // Flush the crossing log and report per-class and per-phase results
+  bool logged = crossingLog.close();
+  behaviorMix.printSummary();
+  drivewayGate.printSummary();
+  inspector.printSummary();
+  loadGenerator.printCurve(numLizards);
+  threadLayout.printSummary(numLizards + numCats);
+  directionBias.printSummary();
+  debugLog.printSummary();
+  PRINT_PROFILE();
  
-	// Exit happily
-  return 0;
-}
\ No newline at end of file
+	// Exit happily, unless the crossing log is incomplete
+  return logged ? 0 : 1;
+}
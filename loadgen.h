@@ -0,0 +1,367 @@
+/**
+ * File: loadgen.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Open-loop load generator for the driveway gates. A normal lizard only
+ * comes back to the gate after its own crossing, so a slow gate slows
+ * down its own arrivals and never shows how badly it would fall behind.
+ * With -g the lizards stop sleeping and eating; instead the main thread
+ * generates crossing requests at a fixed rate, Poisson or evenly spaced,
+ * whether or not earlier requests are done. Idle lizards take requests
+ * in arrival order and cross through the real gates.
+ *
+ * Every request is stamped with the time it was due, and its latency is
+ * measured from there to the end of the crossing. Time spent waiting for
+ * a free lizard counts too, so a late generator or a busy pool cannot
+ * hide queueing. Each rate of the sweep runs as a world of its own.
+ * Requests still queued when the world ends are counted as backlog.
+ * At the end the sweep prints throughput and latency percentiles per
+ * offered rate, and between which rates the gate stopped keeping up
+ * (its knee). A gate keeps up with a rate if it started at least
+ * LOADGEN_KEEP_UP of the requests; latency is reported but does not
+ * decide the knee.
+ *
+ * The rates can be listed, or found automatically with "auto". An
+ * automatic sweep starts at LOADGEN_AUTO_START requests per second (or
+ * the rate given after "auto:") and doubles the rate each world until
+ * the gate stops keeping up, halving instead if it could not keep up
+ * with the first rate. It then bisects between the fastest rate the gate
+ * kept up with and the slowest it did not, LOADGEN_AUTO_REFINE times,
+ * to narrow the knee down. No sweep runs more than LOADGEN_MAX_RATES
+ * worlds.
+ */
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <math.h>   // For log
+#include <stdint.h> // For fixed width integers
+#include <stdio.h>  // For printf
+#include <stdlib.h> // For strtod
+#include <string.h> // For strncmp
+#include <unistd.h> // For usleep
+
+#include <algorithm>          // For sorting the curve by rate
+#include <atomic>             // For the completion counters
+#include <condition_variable> // For waking idle lizards
+#include <deque>              // For the request queue
+#include <mutex>              // For guarding the request queue
+#include <vector>             // For the rates and results
+
+#include "behavior.h"  // For Rng
+#include "crosslog.h"  // For monotonicMicros
+#include "histogram.h" // For latency percentiles
+
+#define LOADGEN_MAX_RATES   32   // Rates one sweep can hold
+#define LOADGEN_KEEP_UP     0.9  // Share of the requests a gate must serve to keep up
+#define LOADGEN_AUTO_START  0.25 // First rate of an automatic sweep, per second
+#define LOADGEN_AUTO_REFINE 2    // Bisections of the knee after an automatic sweep finds it
+
+// How request arrival times are spaced
+enum ArrivalProcess {
+  ARRIVAL_POISSON,  // Exponential gaps, as independent arrivals would be
+  ARRIVAL_CONSTANT  // Even gaps
+};
+
+// One request to cross the driveway
+struct CrossingRequest {
+  uint64_t due;       // monotonicMicros() the request arrived
+  uint32_t direction; // 0 for sago to monkey grass, 1 for the way back
+};
+
+class LoadGenerator {
+  // Results of one offered rate
+  struct Point {
+    double   rate;       // Offered requests per second
+    uint64_t arrivals;   // Requests generated
+    uint64_t completed;  // Crossings finished within the world
+    uint64_t queued;     // Requests that arrived with every lizard busy
+    uint64_t backlog;    // Requests never started
+    uint64_t p50, p90, p99, max; // Latency from arrival to the other side
+    uint64_t waitP99;    // Latency from arrival to stepping on the driveway
+    double   seconds;    // Length of the world
+  };
+
+  ArrivalProcess              _process;
+  std::vector<double>         _rates;       // Offered rates, in order
+  size_t                      _current;     // Rate of the world being run
+  double                      _towardsGrass; // Chance a request goes sago -> monkey grass
+  bool                        _auto;        // Rates are found as the sweep goes
+  double                      _keptUp;      // Fastest rate kept up with so far, 0 if none (auto)
+  double                      _saturated;   // Slowest rate not kept up with, 0 if none (auto)
+  int                         _refined;     // Bisections of the knee so far (auto)
+
+  std::deque<CrossingRequest> _queue;  // Requests no lizard has taken yet
+  std::mutex                  _mutex;  // Guards _queue, _idle and _closed
+  std::condition_variable     _cv;     // Wakes idle lizards
+  int                         _idle;   // Lizards waiting for a request
+  bool                        _closed; // The world ended; no more requests
+
+  uint64_t              _arrivals;  // Requests generated in this world
+  uint64_t              _queued;    // Requests that found every lizard busy
+  uint64_t              _backlog;   // Requests dropped at the end of the world
+  uint64_t              _windowEnd; // monotonicMicros() the world stops generating
+  std::atomic<uint64_t> _completed; // Crossings finished before _windowEnd
+  LatencyHistogram      _latency;   // Arrival to the other side
+  LatencyHistogram      _wait;      // Arrival to stepping on the driveway
+  std::vector<Point>    _points;
+
+  public:
+    LoadGenerator() : _process(ARRIVAL_POISSON), _current(0), _towardsGrass(0.5), _auto(false),
+                      _keptUp(0), _saturated(0), _refined(0), _idle(0), _closed(false),
+                      _arrivals(0), _queued(0), _backlog(0), _windowEnd(0), _completed(0) {}
+
+    /**
+     * Turns the generator on from a spec like "poisson:0.5,1,1.5",
+     * "constant:2" or "auto:0.5". Without a prefix arrivals are Poisson.
+     *
+     * @return false if the spec has no valid, positive rates.
+     */
+    bool parse(const char *spec) {
+      _process = ARRIVAL_POISSON;
+      if(strncmp(spec, "poisson:", 8) == 0) {
+        spec += 8;
+      } else if(strncmp(spec, "constant:", 9) == 0) {
+        _process = ARRIVAL_CONSTANT;
+        spec += 9;
+      }
+
+      _rates.clear();
+      _auto = strncmp(spec, "auto", 4) == 0;
+      if(_auto) {
+        char *end = (char *)spec + 4;
+        double start = *end == ':' ? strtod(end + 1, &end) : LOADGEN_AUTO_START;
+        if(*end || start <= 0) {
+          return false;
+        }
+        _rates.push_back(start);
+        _keptUp = _saturated = 0;
+        _refined = 0;
+        return true;
+      }
+      while(*spec) {
+        char *end;
+        double rate = strtod(spec, &end);
+        if(end == spec || rate <= 0 || (*end && *end != ',') || _rates.size() >= LOADGEN_MAX_RATES) {
+          _rates.clear();
+          return false;
+        }
+        _rates.push_back(rate);
+        spec = *end ? end + 1 : end;
+      }
+      return !_rates.empty();
+    }
+
+    bool isOn() const { return !_rates.empty(); }
+
+    /**
+     * Number of rates in the sweep, one world each. An automatic sweep
+     * adds the next rate in finishRate(), so ask again after each world.
+     */
+    size_t numRates() const { return _rates.size(); }
+
+    /**
+     * Sets the share of requests that go sago -> monkey grass.
+     */
+    void setSkew(double towardsGrass) { _towardsGrass = towardsGrass; }
+
+    /**
+     * Gets ready to run the world of rate number index.
+     */
+    void select(size_t index) {
+      _current = index;
+      _queue.clear();
+      _closed = false;
+      _arrivals = _queued = _backlog = 0;
+      _completed = 0;
+      _latency.reset();
+      _wait.reset();
+    }
+
+    /**
+     * Generates requests at the selected rate for the length of a world.
+     * Runs on the main thread in place of sleeping through the world.
+     */
+    void generate(int seconds) {
+      Rng rng((uint64_t)random());
+      double rate = _rates[_current];
+      uint64_t start = monotonicMicros();
+      _windowEnd = start + seconds * 1000000ull;
+
+      double due = (double)start;
+      for(;;) {
+        due += _process == ARRIVAL_POISSON ? -log(1.0 - rng.uniform()) / rate * 1e6 : 1e6 / rate;
+        if(due >= _windowEnd) {
+          break;
+        }
+        uint64_t now = monotonicMicros();
+        if(due > now) {
+          usleep((useconds_t)(due - now));
+        }
+
+        CrossingRequest request = { (uint64_t)due, rng.uniform() < _towardsGrass ? 0u : 1u };
+        std::lock_guard<std::mutex> lock(_mutex);
+        _arrivals++;
+        if(_idle == 0) {
+          _queued++;
+        }
+        _queue.push_back(request);
+        _cv.notify_one();
+      }
+
+      uint64_t now = monotonicMicros();
+      if(_windowEnd > now) {
+        usleep((useconds_t)(_windowEnd - now));
+      }
+    }
+
+    /**
+     * Ends the world: requests nobody took are dropped and counted as
+     * backlog, and idle lizards are let go.
+     */
+    void close() {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _backlog = _queue.size();
+      _queue.clear();
+      _closed = true;
+      _cv.notify_all();
+    }
+
+    /**
+     * Hands a lizard the oldest request, waiting for one if need be.
+     *
+     * @return false once the world has ended.
+     */
+    bool take(CrossingRequest &request) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _idle++;
+      _cv.wait(lock, [this] { return !_queue.empty() || _closed; });
+      _idle--;
+      if(_queue.empty()) {
+        return false;
+      }
+      request = _queue.front();
+      _queue.pop_front();
+      return true;
+    }
+
+    /**
+     * Records a finished request.
+     *
+     * @param entered - monotonicMicros() the lizard stepped onto the driveway.
+     */
+    void completed(const CrossingRequest &request, uint64_t entered) {
+      uint64_t now = monotonicMicros();
+      _latency.record(now - request.due);
+      _wait.record(entered - request.due);
+      if(now <= _windowEnd) {
+        _completed.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    /**
+     * Keeps the results of the world that just ended and, in an
+     * automatic sweep, picks the next rate. Call once its lizards are
+     * done.
+     */
+    void finishRate(int seconds) {
+      Point point;
+      point.rate = _rates[_current];
+      point.arrivals = _arrivals;
+      point.completed = _completed.load();
+      point.queued = _queued;
+      point.backlog = _backlog;
+      point.p50 = _latency.percentile(0.50);
+      point.p90 = _latency.percentile(0.90);
+      point.p99 = _latency.percentile(0.99);
+      point.max = _latency.max();
+      point.waitP99 = _wait.percentile(0.99);
+      point.seconds = seconds;
+      _points.push_back(point);
+
+      if(_auto && _rates.size() < LOADGEN_MAX_RATES) {
+        nextRate(point);
+      }
+    }
+
+    /**
+     * Prints the latency-versus-throughput curve and where the gate
+     * stopped keeping up with the offered rate.
+     *
+     * @param lizards - Lizards serving requests.
+     */
+    void printCurve(int lizards) const {
+      if(_points.empty()) {
+        return;
+      }
+
+      printf("\nopen-loop load: %s arrivals, %d lizards, %.0f s per rate\n",
+             _process == ARRIVAL_POISSON ? "poisson" : "constant", lizards, _points[0].seconds);
+      printf("%8s %9s %10s %11s %9s %9s %9s %9s %12s %8s %8s\n", "rate /s", "arrivals",
+             "completed", "through /s", "p50 ms", "p90 ms", "p99 ms", "max ms", "wait p99 ms",
+             "queued", "backlog");
+
+      // An automatic sweep runs its rates out of order
+      std::vector<Point> points(_points);
+      std::sort(points.begin(), points.end(),
+                [](const Point &a, const Point &b) { return a.rate < b.rate; });
+
+      int knee = -1;
+      for(size_t i = 0; i < points.size(); i++) {
+        const Point &p = points[i];
+        double throughput = p.completed / p.seconds;
+        printf("%8.2f %9llu %10llu %11.2f %9.1f %9.1f %9.1f %9.1f %12.1f %8llu %8llu\n", p.rate,
+               (unsigned long long)p.arrivals, (unsigned long long)p.completed, throughput,
+               p.p50 / 1e3, p.p90 / 1e3, p.p99 / 1e3, p.max / 1e3, p.waitP99 / 1e3,
+               (unsigned long long)p.queued, (unsigned long long)p.backlog);
+        if(knee < 0 && !keptUp(p)) {
+          knee = (int)i;
+        }
+      }
+
+      if(knee < 0) {
+        printf("kept up with every rate up to %.2f /s\n", points.back().rate);
+      } else if(knee == 0) {
+        printf("saturated at the lowest rate, %.2f /s\n", points[0].rate);
+      } else {
+        printf("saturates between %.2f /s and %.2f /s\n", points[knee - 1].rate,
+               points[knee].rate);
+      }
+      fflush(stdout);
+    }
+
+  private:
+    /**
+     * Returns true if the gate kept up with the rate of a world. Every
+     * request a lizard took gets finished, so the backlog is what was
+     * never served.
+     */
+    static bool keptUp(const Point &p) {
+      return p.arrivals - p.backlog >= LOADGEN_KEEP_UP * p.arrivals;
+    }
+
+    /**
+     * Adds the next rate of an automatic sweep: double until the gate
+     * saturates (halve if it never kept up), then bisect the knee
+     * LOADGEN_AUTO_REFINE times.
+     */
+    void nextRate(const Point &p) {
+      if(keptUp(p)) {
+        _keptUp = std::max(_keptUp, p.rate);
+      } else {
+        _saturated = _saturated == 0 ? p.rate : std::min(_saturated, p.rate);
+      }
+
+      if(_saturated == 0) {
+        _rates.push_back(p.rate * 2);
+      } else if(_keptUp == 0) {
+        _rates.push_back(p.rate / 2);
+      } else if(_refined < LOADGEN_AUTO_REFINE) {
+        _refined++;
+        _rates.push_back((_keptUp + _saturated) / 2);
+      }
+    }
+};
+
+#endif // LOADGEN_H
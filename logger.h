@@ -0,0 +1,338 @@
+/**
+ * File: logger.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Asynchronous debug output for -d. Every debug line used to take
+ * cout_mutex, format with <<, and flush, so each line cost a write()
+ * system call made under one lock shared by every lizard and cat.
+ *
+ * With DebugLog a thread formats its line into a ring of its own with
+ * no locks. One writer thread collects the finished lines from all
+ * rings every LOG_FLUSH_MICROS and hands them to the kernel in a single
+ * write(). Lines keep their format and each thread's lines stay in
+ * order. Lines of different threads in the same batch are grouped by
+ * thread, so their interleaving can differ from the order they were
+ * written in.
+ *
+ * When a thread outruns the writer and its ring is full, the overflow
+ * policy (-o) decides what happens. LOG_BLOCK waits for the writer to
+ * make room, so no line is lost, and is the default. LOG_DROP throws
+ * the line away so the thread never waits. LOG_COUNT drops lines too,
+ * but once the ring has room again the thread writes how many it
+ * dropped, e.g. "[debug log: 12 lines dropped]", so the gap shows up
+ * where it happened. Every policy counts the lines it affects, and the
+ * counts are printed at the end.
+ *
+ * A ring belongs to one thread at a time. When a thread exits, its ring
+ * is handed to the next thread that logs, so worlds that are rebuilt
+ * over and over (-r) reuse the same rings.
+ *
+ * A crash ends the program with exit() while lizards are still logging,
+ * so a DebugLog is never torn down: it has no destructor and the
+ * programs allocate theirs with new and leave it. On the way to exit()
+ * finalFlush() writes out what is left and mutes the log, so nothing
+ * comes out after the crash report.
+ */
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <errno.h>  // For EINTR
+#include <stdarg.h> // For variable arguments
+#include <stdint.h> // For fixed width integers
+#include <stdio.h>  // For vsnprintf and snprintf
+#include <string.h> // For strcmp
+#include <unistd.h> // For write
+
+#include <atomic>             // For the ring positions and counters
+#include <chrono>             // For the flush interval
+#include <condition_variable> // For waking the writer thread
+#include <memory>             // For owning the rings
+#include <mutex>              // For guarding the ring list
+#include <thread>             // For the writer thread
+#include <vector>             // For the ring list and the batch
+
+#define LOG_RING_BYTES   16384 // Bytes of lines a thread can have outstanding
+#define LOG_LINE_BYTES     256 // Longest line, newline included
+#define LOG_FLUSH_MICROS 10000 // How often the writer collects lines
+
+// What a thread does when its ring is full
+enum LogOverflow {
+  LOG_BLOCK, // Wait for the writer to make room
+  LOG_DROP,  // Throw the line away
+  LOG_COUNT  // Throw the line away and note the count in the output later
+};
+
+class DebugLog {
+  // Lines of one thread; the thread appends, the writer takes
+  struct Ring {
+    std::atomic<uint64_t> head;  // Bytes ever taken by the writer
+    std::atomic<uint64_t> tail;  // Bytes ever appended by the thread
+    std::atomic<bool>     owned; // A live thread appends to this ring
+    uint64_t              skipped; // Lines dropped since the last one written (LOG_COUNT)
+    char                  bytes[LOG_RING_BYTES];
+
+    Ring() : head(0), tail(0), owned(true), skipped(0) {}
+  };
+
+  // Gives a thread's ring back when the thread exits
+  struct Owner {
+    Ring *ring;
+
+    Owner() : ring(NULL) {}
+    ~Owner() {
+      if(ring) {
+        ring->owned.store(false);
+      }
+    }
+  };
+
+  std::vector<std::unique_ptr<Ring>> _rings;      // Every ring handed out so far
+  std::mutex                         _ringMutex;  // Guards _rings
+  std::mutex                         _drainMutex; // Held while moving lines to stdout
+  std::mutex                         _wakeMutex;  // Guards _stopping
+  std::condition_variable            _wakeCV;     // Wakes the writer early
+  std::thread                        _writer;     // Background writer thread
+  bool                               _stopping;   // Writer should drain and exit
+  bool                               _closed;     // Final drain done; guarded by _drainMutex
+  std::atomic<bool>                  _muted;      // finalFlush() was called; lines are ignored
+  LogOverflow                        _overflow;   // Policy for a full ring
+  std::atomic<uint64_t>              _lines;      // Lines handed to the log
+  std::atomic<uint64_t>              _dropped;    // Lines thrown away (LOG_DROP, LOG_COUNT)
+  std::atomic<uint64_t>              _blocked;    // Lines that had to wait (LOG_BLOCK)
+  uint64_t                           _writes;     // write() calls made
+
+  public:
+    DebugLog() : _stopping(false), _closed(false), _muted(false), _overflow(LOG_BLOCK), _lines(0),
+                 _dropped(0), _blocked(0), _writes(0) {}
+
+    /**
+     * Sets the overflow policy from its name.
+     *
+     * @return false if the name is not "block", "drop" or "count".
+     */
+    bool setOverflow(const char *name) {
+      if(strcmp(name, "block") == 0) {
+        _overflow = LOG_BLOCK;
+      } else if(strcmp(name, "drop") == 0) {
+        _overflow = LOG_DROP;
+      } else if(strcmp(name, "count") == 0) {
+        _overflow = LOG_COUNT;
+      } else {
+        return false;
+      }
+      return true;
+    }
+
+    /**
+     * Starts the writer thread. Called at the start of every world, so
+     * forked sweep workers get a writer of their own.
+     */
+    void start() {
+      if(_writer.joinable()) {
+        return;
+      }
+      _stopping = false;
+      _writer = std::thread(&DebugLog::writerThread, this);
+    }
+
+    /**
+     * Writes out every line logged so far and stops the writer thread.
+     */
+    void stop() {
+      if(!_writer.joinable()) {
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(_wakeMutex);
+        _stopping = true;
+        _wakeCV.notify_one();
+      }
+      _writer.join();
+    }
+
+    /**
+     * Writes out every line logged so far, from the calling thread, and
+     * ignores every line logged after. Call right before the report of a
+     * crash, which exit() ends. The writer and the rings are left as they
+     * are, since other threads may still be logging while exit() runs.
+     */
+    void finalFlush() {
+      _muted.store(true);
+      std::vector<char> batch;
+      drain(batch, true);
+    }
+
+    /**
+     * Formats one line, printf style, and queues it for the writer. The
+     * newline is added here.
+     */
+    __attribute__((format(printf, 2, 3))) void line(const char *format, ...) {
+      if(_muted.load(std::memory_order_relaxed)) {
+        return;
+      }
+      char text[LOG_LINE_BYTES];
+      va_list args;
+      va_start(args, format);
+      int length = vsnprintf(text, LOG_LINE_BYTES - 1, format, args);
+      va_end(args);
+      if(length < 0) {
+        return;
+      }
+      if(length > LOG_LINE_BYTES - 2) {
+        length = LOG_LINE_BYTES - 2;
+      }
+      text[length++] = '\n';
+
+      Ring &ring = threadRing();
+      _lines.fetch_add(1, std::memory_order_relaxed);
+      uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+
+      // Under LOG_COUNT the lines dropped before this one are noted first
+      char note[LOG_LINE_BYTES];
+      int noteLength = 0;
+      if(ring.skipped) {
+        noteLength = snprintf(note, LOG_LINE_BYTES, "[debug log: %llu lines dropped]\n",
+                              (unsigned long long)ring.skipped);
+      }
+
+      if(tail + noteLength + length - ring.head.load(std::memory_order_acquire) > LOG_RING_BYTES) {
+        if(_overflow != LOG_BLOCK) {
+          _dropped.fetch_add(1, std::memory_order_relaxed);
+          ring.skipped += _overflow == LOG_COUNT;
+          return;
+        }
+        _blocked.fetch_add(1, std::memory_order_relaxed);
+        while(tail + noteLength + length - ring.head.load(std::memory_order_acquire) > LOG_RING_BYTES) {
+          _wakeCV.notify_one();
+          std::this_thread::yield();
+        }
+      }
+
+      for(int i = 0; i < noteLength; i++) {
+        ring.bytes[(tail + i) % LOG_RING_BYTES] = note[i];
+      }
+      tail += noteLength;
+      ring.skipped = 0;
+      for(int i = 0; i < length; i++) {
+        ring.bytes[(tail + i) % LOG_RING_BYTES] = text[i];
+      }
+      ring.tail.store(tail + length, std::memory_order_release);
+
+      // Wake the writer early once the ring is half full
+      if(tail + length - ring.head.load(std::memory_order_relaxed) > LOG_RING_BYTES / 2) {
+        _wakeCV.notify_one();
+      }
+    }
+
+    /**
+     * Prints how many lines went through the log and how many write()
+     * calls they took.
+     */
+    void printSummary() {
+      stop();
+      uint64_t lines = _lines.load();
+      if(!lines) {
+        return;
+      }
+      printf("\ndebug log: %llu lines in %llu writes, %llu dropped, %llu waited for room\n",
+             (unsigned long long)lines, (unsigned long long)_writes,
+             (unsigned long long)_dropped.load(), (unsigned long long)_blocked.load());
+      fflush(stdout);
+    }
+
+  private:
+    /**
+     * Returns the calling thread's ring, taking over a ring whose thread
+     * has exited and whose lines are all written, or adding a new one.
+     */
+    Ring &threadRing() {
+      static thread_local Owner owner;
+      if(owner.ring) {
+        return *owner.ring;
+      }
+
+      std::lock_guard<std::mutex> lock(_ringMutex);
+      for(std::unique_ptr<Ring> &ring : _rings) {
+        bool owned = false;
+        if(ring->head.load() == ring->tail.load() && ring->owned.compare_exchange_strong(owned, true)) {
+          // Drops noted for the thread that exited are not this thread's
+          ring->skipped = 0;
+          owner.ring = ring.get();
+          return *owner.ring;
+        }
+      }
+      _rings.emplace_back(new Ring());
+      owner.ring = _rings.back().get();
+      return *owner.ring;
+    }
+
+    /**
+     * Moves every finished line out of the rings and writes them to
+     * stdout in one go. Nothing is written after the last drain.
+     */
+    void drain(std::vector<char> &batch, bool last = false) {
+      std::lock_guard<std::mutex> drainLock(_drainMutex);
+      if(_closed) {
+        return;
+      }
+      _closed = last;
+      batch.clear();
+      {
+        std::lock_guard<std::mutex> lock(_ringMutex);
+        for(std::unique_ptr<Ring> &ring : _rings) {
+          uint64_t head = ring->head.load(std::memory_order_relaxed);
+          uint64_t tail = ring->tail.load(std::memory_order_acquire);
+          for(uint64_t i = head; i < tail; i++) {
+            batch.push_back(ring->bytes[i % LOG_RING_BYTES]);
+          }
+          ring->head.store(tail, std::memory_order_release);
+        }
+      }
+      if(batch.empty()) {
+        return;
+      }
+
+      // Anything already in cout or stdio goes out first
+      fflush(stdout);
+      const char *next = batch.data();
+      size_t left = batch.size();
+      while(left > 0) {
+        ssize_t written = write(STDOUT_FILENO, next, left);
+        if(written < 0 && errno == EINTR) {
+          continue;
+        }
+        if(written <= 0) {
+          break;
+        }
+        next += written;
+        left -= written;
+      }
+      _writes++;
+    }
+
+    /**
+     * Drains the rings every LOG_FLUSH_MICROS, or sooner when a ring
+     * fills up, until the log is stopped.
+     */
+    void writerThread() {
+      std::vector<char> batch;
+      batch.reserve(LOG_RING_BYTES);
+
+      for(;;) {
+        bool stopping;
+        {
+          std::unique_lock<std::mutex> lock(_wakeMutex);
+          _wakeCV.wait_for(lock, std::chrono::microseconds(LOG_FLUSH_MICROS));
+          stopping = _stopping;
+        }
+        drain(batch);
+        if(stopping) {
+          return;
+        }
+      }
+    }
+};
+
+#endif // LOGGER_H
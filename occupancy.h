@@ -0,0 +1,156 @@
+/**
+ * File: occupancy.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Which lizards are on the driveway, not just how many. The crossing
+ * counters can tell a cat that the driveway is overloaded but not who is
+ * on it. OccupancyMap keeps one bit per lizard and direction in atomic
+ * 64-bit words. A lizard sets its bit when it steps onto the driveway
+ * and clears it when it steps off, each with a single fetch_or or
+ * fetch_and on its own word. There is no lock and no loop, so crossing
+ * costs one more atomic instruction each way.
+ *
+ * Reading the map never blocks. Up to 64 lizards fit in one word per
+ * direction, and one load is an exact snapshot. With more lizards a
+ * reader collects the words until two passes in a row agree, like the
+ * sharded counters, and gives up after OCCUPANCY_PASSES passes. The
+ * snapshot then keeps the last pass and counts the lizards whose bits
+ * changed between any two passes; only their entries may be off, and
+ * the description says how many there are.
+ *
+ * Directions are indexed like the crossing counters: 0 is sago ->
+ * monkey grass, 1 is monkey grass -> sago.
+ */
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <stdint.h> // For fixed width integers
+#include <string.h> // For memcmp
+
+#include <atomic> // For the bitmap words
+#include <memory> // For owning the words
+#include <string> // For the description
+#include <vector> // For snapshots
+
+#define OCCUPANCY_PASSES 8 // Passes a reader makes over a multi-word map
+
+/**
+ * The lizards on the driveway at one instant, as lizard ids.
+ */
+struct OccupancySnapshot {
+  std::vector<uint32_t> lizards[2]; // Ids per direction, in increasing order
+  bool                  exact;      // Two passes agreed (always for one word)
+  uint32_t              moving;     // Lizards seen moving between passes, 0 if exact
+
+  /**
+   * Describes the snapshot for a violation report, e.g.
+   * "on the driveway: sago -> monkey grass 3 7, monkey grass -> sago 12".
+   * A snapshot that never settled says how many of its entries may be
+   * off, e.g. "on the driveway (5 lizards moved while reading, their
+   * entries may be off): ...".
+   */
+  std::string describe() const {
+    static const char *names[2] = { "sago -> monkey grass", "monkey grass -> sago" };
+    std::string text = exact ? "on the driveway:"
+                             : "on the driveway (" + std::to_string(moving) +
+                                 " lizards moved while reading, their entries may be off):";
+    for(int direction = 0; direction < 2; direction++) {
+      text += direction ? ", " : " ";
+      text += names[direction];
+      if(lizards[direction].empty()) {
+        text += " none";
+      }
+      for(uint32_t id : lizards[direction]) {
+        text += " " + std::to_string(id);
+      }
+    }
+    return text;
+  }
+};
+
+class OccupancyMap {
+  std::unique_ptr<std::atomic<uint64_t>[]> _words; // Direction 0 first, then direction 1
+  size_t                                   _numWords; // Words per direction
+
+  public:
+    OccupancyMap() : _numWords(0) {}
+
+    /**
+     * Makes room for lizards 0 to lizards - 1 and empties the map. Call
+     * before any lizard of the world runs; the words are only replaced
+     * when a world has more lizards than the last.
+     */
+    void reset(int lizards) {
+      size_t numWords = ((size_t)(lizards > 0 ? lizards : 1) + 63) / 64;
+      if(numWords > _numWords) {
+        _words.reset(new std::atomic<uint64_t>[2 * numWords]);
+        _numWords = numWords;
+      }
+      for(size_t i = 0; i < 2 * _numWords; i++) {
+        _words[i].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    /**
+     * Marks a lizard as on the driveway.
+     */
+    void enter(int direction, uint32_t lizard) {
+      word(direction, lizard).fetch_or(1ull << (lizard % 64), std::memory_order_release);
+    }
+
+    /**
+     * Marks a lizard as off the driveway.
+     */
+    void leave(int direction, uint32_t lizard) {
+      word(direction, lizard).fetch_and(~(1ull << (lizard % 64)), std::memory_order_release);
+    }
+
+    /**
+     * Takes a snapshot of who is on the driveway, without blocking.
+     */
+    OccupancySnapshot snapshot() const {
+      OccupancySnapshot snapshot;
+      std::vector<uint64_t> words(2 * _numWords), again(2 * _numWords), moved(2 * _numWords, 0);
+
+      collect(words);
+      snapshot.exact = _numWords <= 1;
+      for(int pass = 1; pass < OCCUPANCY_PASSES && !snapshot.exact; pass++) {
+        collect(again);
+        snapshot.exact = memcmp(words.data(), again.data(), words.size() * sizeof(uint64_t)) == 0;
+        for(size_t i = 0; i < words.size(); i++) {
+          moved[i] |= words[i] ^ again[i];
+        }
+        words.swap(again);
+      }
+
+      // A lizard counts once even if it moved in both directions
+      snapshot.moving = 0;
+      for(size_t i = 0; i < _numWords && !snapshot.exact; i++) {
+        snapshot.moving += __builtin_popcountll(moved[i] | moved[_numWords + i]);
+      }
+
+      for(int direction = 0; direction < 2; direction++) {
+        for(size_t i = 0; i < _numWords; i++) {
+          for(uint64_t bits = words[direction * _numWords + i]; bits; bits &= bits - 1) {
+            snapshot.lizards[direction].push_back((uint32_t)(i * 64 + __builtin_ctzll(bits)));
+          }
+        }
+      }
+      return snapshot;
+    }
+
+  private:
+    std::atomic<uint64_t> &word(int direction, uint32_t lizard) {
+      return _words[direction * _numWords + lizard / 64];
+    }
+
+    void collect(std::vector<uint64_t> &words) const {
+      for(size_t i = 0; i < words.size(); i++) {
+        words[i] = _words[i].load(std::memory_order_acquire);
+      }
+    }
+};
+
+#endif // OCCUPANCY_H
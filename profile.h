@@ -0,0 +1,299 @@
+/**
+ * File: profile.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Optional hot-path profiler shared by lizards.cpp and lizardsUni.cpp.
+ * Each lizard phase is wrapped in a PROFILE_PHASE scope that samples the
+ * wall clock, the time stamp counter and, where the kernel allows it,
+ * per-thread perf_event_open counters (context switches, cache misses
+ * and futex syscalls). The totals are printed as a per-phase table when
+ * the program shuts down.
+ *
+ * Profiling is compiled in with "make PROFILE=1" and switched on at run
+ * time with --profile. With PROFILE left at 0 every macro below expands
+ * to nothing (or to a plain lock_guard) so the hot path is untouched.
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+// Phases a lizard goes through, plus the waits nested inside them
+enum Phase {
+  PHASE_SLEEP,          // sleepNow()
+  PHASE_SAGO_SAFE,      // sago2MonkeyGrassIsSafe()
+  PHASE_CROSS_SAGO,     // crossSago2MonkeyGrass()
+  PHASE_MADE_IT_GRASS,  // madeIt2MonkeyGrass()
+  PHASE_EAT,            // eat()
+  PHASE_GRASS_SAFE,     // monkeyGrass2SagoIsSafe()
+  PHASE_CROSS_GRASS,    // crossMonkeyGrass2Sago()
+  PHASE_MADE_IT_SAGO,   // madeIt2Sago()
+  PHASE_SEM_WAIT,       // sem_wait on the driveway (inside *IsSafe)
+  PHASE_DIRECTION_WAIT, // direction gate queue (inside *IsSafe)
+  PHASE_DIRECTION_MUTEX,// acquiring direction_mutex (lizardsUni gate)
+  PHASE_COUT_MUTEX,     // acquiring cout_mutex (anywhere)
+  NUM_PHASES
+};
+
+#if PROFILE
+
+#include <linux/perf_event.h>    // For perf_event_attr
+#include <sys/syscall.h>         // For SYS_perf_event_open
+#include <time.h>                // For clock_gettime
+#include <unistd.h>              // For read/close
+
+#include <atomic>                // For lock-free phase totals
+#include <cstdint>               // For fixed width integers
+#include <cstdio>                // For printf
+#include <mutex>                 // For lock_guard
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>           // For __rdtsc
+#endif
+
+extern int profiling; // Set by --profile; sampling is skipped while 0
+
+// Per-thread counters read around every phase
+enum ProfileCounter {
+  COUNTER_CONTEXT_SWITCHES,
+  COUNTER_CACHE_MISSES,
+  COUNTER_FUTEX_CALLS,
+  NUM_COUNTERS
+};
+
+// Process-wide totals for one phase
+struct PhaseTotals {
+  std::atomic<uint64_t> calls;
+  std::atomic<uint64_t> nanos;
+  std::atomic<uint64_t> cycles;
+  std::atomic<uint64_t> counters[NUM_COUNTERS];
+};
+
+// Names printed in the shutdown table, indexed by Phase
+static const char *const PHASE_NAMES[NUM_PHASES] = {
+  "sleepNow", "sago2MonkeyGrassIsSafe", "crossSago2MonkeyGrass",
+  "madeIt2MonkeyGrass", "eat", "monkeyGrass2SagoIsSafe",
+  "crossMonkeyGrass2Sago", "madeIt2Sago", "  sem_wait",
+  "  direction_wait", "  direction_mutex", "  cout_mutex"
+};
+
+/**
+ * Returns the totals for every phase. Zero-initialized static storage,
+ * so no constructor runs before the first lizard thread starts.
+ */
+inline PhaseTotals *phaseTotals() {
+  static PhaseTotals totals[NUM_PHASES];
+  return totals;
+}
+
+/**
+ * Returns the tracepoint id of sys_enter_futex, or -1 if tracefs is not
+ * mounted or not readable.
+ */
+inline long futexTracepointId() {
+  static const char *const paths[] = {
+    "/sys/kernel/tracing/events/syscalls/sys_enter_futex/id",
+    "/sys/kernel/debug/tracing/events/syscalls/sys_enter_futex/id"
+  };
+  for(const char *path : paths) {
+    FILE *file = fopen(path, "r");
+    long id;
+    if(file) {
+      int found = fscanf(file, "%ld", &id);
+      fclose(file);
+      if(found == 1) {
+        return id;
+      }
+    }
+  }
+  return -1;
+}
+
+/**
+ * Per-thread perf_event_open file descriptors. Opened lazily by the first
+ * phase a thread profiles; a counter the kernel refuses stays at -1 and
+ * reads as zero.
+ */
+class ThreadCounters {
+  int _fds[NUM_COUNTERS];
+
+  public:
+    ThreadCounters() {
+      static const long futexId = futexTracepointId();
+      _fds[COUNTER_CONTEXT_SWITCHES] = open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+      _fds[COUNTER_CACHE_MISSES]     = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+      _fds[COUNTER_FUTEX_CALLS]      = futexId < 0 ? -1 : open(PERF_TYPE_TRACEPOINT, futexId);
+    }
+
+    ~ThreadCounters() {
+      for(int fd : _fds) {
+        if(fd >= 0) {
+          close(fd);
+        }
+      }
+    }
+
+    void read(uint64_t values[NUM_COUNTERS]) const {
+      for(int i = 0; i < NUM_COUNTERS; i++) {
+        values[i] = 0;
+        if(_fds[i] >= 0 && ::read(_fds[i], &values[i], sizeof(values[i])) != sizeof(values[i])) {
+          values[i] = 0;
+        }
+      }
+    }
+
+    bool available(int counter) const { return _fds[counter] >= 0; }
+
+  private:
+    // Context switches and futex entries happen in the kernel, so count
+    // kernel events when allowed and fall back to user-only otherwise
+    static int open(uint32_t type, uint64_t config) {
+      struct perf_event_attr attr = {};
+      attr.size = sizeof(attr);
+      attr.type = type;
+      attr.config = config;
+      attr.exclude_hv = 1;
+
+      int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      if(fd < 0) {
+        attr.exclude_kernel = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      }
+      return fd;
+    }
+};
+
+/**
+ * Returns the counters of the calling thread.
+ */
+inline ThreadCounters &threadCounters() {
+  static thread_local ThreadCounters counters;
+  return counters;
+}
+
+/**
+ * Reads the time stamp counter, or 0 where there is none.
+ */
+inline uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Reads CLOCK_MONOTONIC in nanoseconds.
+ */
+inline uint64_t readNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Samples one phase from construction to destruction and adds the
+ * difference to that phase's totals.
+ */
+class PhaseScope {
+  Phase    _phase;
+  bool     _active;
+  uint64_t _nanos;
+  uint64_t _cycles;
+  uint64_t _counters[NUM_COUNTERS];
+
+  public:
+    explicit PhaseScope(Phase phase) : _phase(phase), _active(profiling != 0) {
+      if(_active) {
+        threadCounters().read(_counters);
+        _cycles = readCycles();
+        _nanos = readNanos();
+      }
+    }
+
+    ~PhaseScope() {
+      if(!_active) {
+        return;
+      }
+
+      uint64_t nanos = readNanos();
+      uint64_t cycles = readCycles();
+      uint64_t counters[NUM_COUNTERS];
+      threadCounters().read(counters);
+
+      PhaseTotals &totals = phaseTotals()[_phase];
+      totals.calls.fetch_add(1, std::memory_order_relaxed);
+      totals.nanos.fetch_add(nanos - _nanos, std::memory_order_relaxed);
+      totals.cycles.fetch_add(cycles - _cycles, std::memory_order_relaxed);
+      for(int i = 0; i < NUM_COUNTERS; i++) {
+        totals.counters[i].fetch_add(counters[i] - _counters[i], std::memory_order_relaxed);
+      }
+    }
+};
+
+/**
+ * A lock_guard that books the time spent acquiring the mutex to a phase.
+ */
+template <class Mutex>
+class ProfiledLockGuard {
+  Mutex &_mutex;
+
+  public:
+    ProfiledLockGuard(Mutex &mutex, Phase phase) : _mutex(mutex) {
+      PhaseScope scope(phase);
+      _mutex.lock();
+    }
+
+    ~ProfiledLockGuard() { _mutex.unlock(); }
+
+    ProfiledLockGuard(const ProfiledLockGuard &) = delete;
+    ProfiledLockGuard &operator=(const ProfiledLockGuard &) = delete;
+};
+
+/**
+ * Prints the per-phase breakdown. Nested phases are indented and their
+ * time is also included in the phase that contains them.
+ */
+inline void printProfile() {
+  ThreadCounters &counters = threadCounters();
+
+  printf("\n%-24s %10s %12s %12s %12s %10s %12s %10s\n", "phase", "calls",
+         "total ms", "mean us", "mean kcyc", "ctx-sw", "cache-miss", "futex");
+  for(int phase = 0; phase < NUM_PHASES; phase++) {
+    PhaseTotals &totals = phaseTotals()[phase];
+    uint64_t calls = totals.calls.load();
+    double   perCall = calls ? 1.0 / calls : 0.0;
+
+    printf("%-24s %10llu %12.1f %12.1f %12.1f", PHASE_NAMES[phase],
+           (unsigned long long)calls, totals.nanos.load() / 1e6,
+           totals.nanos.load() * perCall / 1e3, totals.cycles.load() * perCall / 1e3);
+    for(int i = 0; i < NUM_COUNTERS; i++) {
+      int width = i == COUNTER_CACHE_MISSES ? 12 : 10;
+      if(counters.available(i)) {
+        printf(" %*llu", width, (unsigned long long)totals.counters[i].load());
+      } else {
+        printf(" %*s", width, "n/a");
+      }
+    }
+    printf("\n");
+  }
+  fflush(stdout);
+}
+
+#define PROFILE_PHASE(phase) PhaseScope _phaseScope(phase)
+#define PROFILED_LOCK_GUARD(name, mutex, phase) ProfiledLockGuard<decltype(mutex)> name(mutex, phase)
+#define PRINT_PROFILE() do { if(profiling) printProfile(); } while(0)
+
+#else
+
+#define PROFILE_PHASE(phase)
+#define PROFILED_LOCK_GUARD(name, mutex, phase) std::lock_guard<decltype(mutex)> name(mutex)
+#define PRINT_PROFILE()
+
+#endif // PROFILE
+
+#endif // PROFILE_H
@@ -0,0 +1,291 @@
+/**
+ * File: smallworld.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Virtual-time engine for small worlds whose size is known when the
+ * program is compiled, like the default world of 20 lizards and 2 cats.
+ * SimWorld is built for millions of lizards: lazy arrays, a calendar of
+ * first wake-ups, an event heap and deques at the gates. For a sweep of
+ * many small worlds all of that is overhead.
+ *
+ * SmallWorld<Lizards, Cats, Capacity> keeps every lizard and cat in
+ * std::arrays sized by the template, so a world lives on the stack and
+ * never allocates. Each lizard and cat has at most one pending event, so
+ * instead of a heap there is one sort key per lizard and cat, and the
+ * next event is the smallest key of a scan whose length the compiler
+ * knows. A key packs the time, kind and id of the event, so the scan
+ * is a run of branch-free minimums. The lizards on the driveway are a
+ * bitmask per direction, and the lines at the gates are rings of
+ * Lizards slots.
+ *
+ * The gates, the order of events at equal times (exits, then wake-ups,
+ * then cats, each by id) and the random numbers are those of SimWorld,
+ * so both engines give the same results for the same seed.
+ */
+#ifndef SMALLWORLD_H
+#define SMALLWORLD_H
+
+#include <stdint.h> // For fixed width integers
+
+#include <array>       // For the fixed-size state
+#include <type_traits> // For picking the mask type
+
+#include "behavior.h" // For behavior classes and Rng
+
+template <int Lizards, int Cats, int Capacity>
+class SmallWorld {
+  static_assert(Lizards >= 1 && Lizards <= 64, "a lizard mask holds 1 to 64 lizards");
+  static_assert(Cats >= 0 && Lizards + Cats <= 128, "sort keys hold 128 lizards and cats");
+  static_assert(Capacity >= 1, "a world needs a driveway");
+
+  // Lizards on the driveway, one bit per lizard
+  typedef typename std::conditional<(Lizards <= 32), uint32_t, uint64_t>::type Mask;
+
+  // What a pending event does, in the order events at equal times go
+  enum Kind { KIND_EXIT, KIND_WAKE, KIND_CAT };
+
+  static constexpr int     ENTITIES = Lizards + Cats; // Lizards first, then cats
+  static constexpr int64_t SECOND   = 1000000;        // Virtual microseconds per second
+  static constexpr int64_t NO_EVENT = INT64_MAX;
+
+  // Lizards waiting in line at a gate, oldest first
+  struct Line {
+    std::array<uint8_t, Lizards> ids;
+    int                          head;
+    int                          size;
+
+    void push(int id) { ids[(head + size++) % Lizards] = (uint8_t)id; }
+    int pop() {
+      int id = ids[head];
+      head = (head + 1) % Lizards;
+      size--;
+      return id;
+    }
+  };
+
+  // Settings
+  int64_t _end;      // Virtual time the world ends
+  int64_t _catSleep; // Longest cat nap, in seconds
+
+  // Lizards and cats
+  std::array<int64_t, ENTITIES>              _key;         // Pending event, NO_EVENT if none
+  std::array<uint64_t, ENTITIES>             _rng;         // Rng state
+  std::array<const BehaviorClass *, Lizards> _behavior;    // Behavior class per lizard
+  std::array<int64_t, Lizards>               _crossMicros; // Time the lizard takes to cross
+  std::array<int64_t, Lizards>               _waitStart;   // Gate arrival; the wait once on the driveway
+  std::array<uint8_t, Lizards>               _heading;     // 0 towards the monkey grass, 1 towards the sago
+  int64_t                                    _now;
+
+  // Gates
+  int  _freeSpots; // Free spots at the counting gate
+  Line _spotLine;  // Lizards waiting for a spot
+  int  _direction; // Current direction, -1 for none
+  Mask _on[2];     // Lizards on the driveway per direction
+  Line _line[2];   // Lizards with a spot waiting for the direction
+
+  public:
+    // Results
+    uint64_t crossings[2];
+    uint64_t waitMicros;
+    uint64_t events;
+    uint64_t catChecks;
+    uint64_t violations;
+
+    /**
+     * Builds a world and draws every lizard's first wake-up and every
+     * cat's first check, seeded the way SimWorld seeds them.
+     *
+     * @param mix          - Behavior classes of the population.
+     * @param crossSeconds - CROSS_SECONDS of the program.
+     * @param catSleep     - MAX_CAT_SLEEP of the program.
+     * @param seconds      - Virtual seconds until the end of the world.
+     * @param seed         - Seed every random number derives from.
+     */
+    SmallWorld(const BehaviorMix &mix, int crossSeconds, int catSleep, int seconds, uint64_t seed)
+      : _end(seconds * SECOND), _catSleep(catSleep), _now(0), _freeSpots(Capacity),
+        _direction(-1), waitMicros(0), events(0), catChecks(0), violations(0) {
+      _spotLine.head = _spotLine.size = 0;
+      for(int d = 0; d < 2; d++) {
+        _on[d] = 0;
+        _line[d].head = _line[d].size = 0;
+        crossings[d] = 0;
+      }
+
+      for(int id = 0; id < Lizards; id++) {
+        Rng rng((seed << 32) ^ (uint32_t)id);
+        _behavior[id] = mix.classFor(id, Lizards);
+        _crossMicros[id] = (int64_t)(crossSeconds * _behavior[id]->crossScale * SECOND + 0.5);
+        _heading[id] = 0;
+        _key[id] = keyOf(draw(_behavior[id]->sleep, rng), KIND_WAKE, id);
+        _rng[id] = rng.state();
+      }
+      for(int cat = 0; cat < Cats; cat++) {
+        Rng rng(((seed << 32) ^ 0x80000000u) + cat);
+        _key[Lizards + cat] = keyOf(draw({ DIST_UNIFORM, (double)_catSleep }, rng), KIND_CAT,
+                                    Lizards + cat);
+        _rng[Lizards + cat] = rng.state();
+      }
+    }
+
+    /**
+     * Processes events in virtual time order until every lizard made it
+     * home after the end of the world.
+     */
+    void run() {
+      for(;;) {
+        int64_t key = _key[0];
+        for(int i = 1; i < ENTITIES; i++) {
+          key = _key[i] < key ? _key[i] : key;
+        }
+        if(key == NO_EVENT) {
+          return;
+        }
+
+        int next = (int)(key & 127);
+        _key[next] = NO_EVENT;
+        _now = key >> 9;
+        events++;
+        switch((key >> 7) & 3) {
+          case KIND_EXIT: finishCrossing(next); break;
+          case KIND_WAKE: arriveAtGate(next); break;
+          case KIND_CAT:  catCheck(next - Lizards); break;
+        }
+      }
+    }
+
+    int64_t now() const { return _now; }
+
+  private:
+    /**
+     * Packs an event of lizard or cat id into a key that sorts by time,
+     * then kind, then id.
+     */
+    static int64_t keyOf(int64_t time, Kind kind, int id) { return time << 9 | kind << 7 | id; }
+
+    static Mask bit(int id) { return (Mask)1 << id; }
+
+    /**
+     * Draws a duration in whole virtual microseconds.
+     */
+    static int64_t draw(const Duration &duration, Rng &rng) {
+      return (int64_t)(drawDuration(duration, rng) * SECOND + 0.5);
+    }
+
+    /**
+     * Draws a duration with the random numbers of lizard or cat id.
+     */
+    int64_t drawFor(int id, const Duration &duration) {
+      Rng rng;
+      rng.setState(_rng[id]);
+      int64_t micros = draw(duration, rng);
+      _rng[id] = rng.state();
+      return micros;
+    }
+
+    /**
+     * Takes a spot at the counting gate if one is free, else gets in line.
+     */
+    void arriveAtGate(int id) {
+      _waitStart[id] = _now;
+      if(_freeSpots > 0) {
+        _freeSpots--;
+        enterDirection(id);
+      } else {
+        _spotLine.push(id);
+      }
+    }
+
+    /**
+     * Crosses right away if the driveway is empty or going this lizard's
+     * way, else waits for the direction to flip.
+     */
+    void enterDirection(int id) {
+      int direction = _heading[id];
+      if(_direction < 0 || _direction == direction) {
+        _direction = direction;
+        startCrossing(id);
+      } else {
+        _line[direction].push(id);
+      }
+    }
+
+    /**
+     * Steps onto the driveway and schedules reaching the other side.
+     */
+    void startCrossing(int id) {
+      _on[_heading[id]] |= bit(id);
+      _waitStart[id] = _now - _waitStart[id];
+      _key[id] = keyOf(_now + _crossMicros[id], KIND_EXIT, id);
+    }
+
+    /**
+     * Reaches the other side: leaves the direction gate, frees the spot
+     * and goes on to eat, sleep or stop.
+     */
+    void finishCrossing(int id) {
+      int direction = _heading[id];
+      crossings[direction]++;
+      waitMicros += _waitStart[id];
+
+      leaveDirection(id, direction);
+
+      // Hand the spot to the next lizard in line
+      if(_spotLine.size == 0) {
+        _freeSpots++;
+      } else {
+        enterDirection(_spotLine.pop());
+      }
+
+      // Eat, sleep, or stop if the world has ended
+      if(direction == 0) {
+        _heading[id] = 1;
+        _key[id] = keyOf(_now + drawFor(id, _behavior[id]->eat), KIND_WAKE, id);
+      } else if(_now < _end) {
+        _heading[id] = 0;
+        _key[id] = keyOf(_now + drawFor(id, _behavior[id]->sleep), KIND_WAKE, id);
+      }
+    }
+
+    /**
+     * Takes a lizard off the driveway. The last one out flips the gate
+     * and admits a convoy of up to Capacity waiting lizards.
+     */
+    void leaveDirection(int id, int direction) {
+      _on[direction] &= ~bit(id);
+      if(_on[direction]) {
+        return;
+      }
+
+      int next = _line[1 - direction].size == 0 ? direction : 1 - direction;
+      Line &line = _line[next];
+      if(line.size == 0) {
+        _direction = -1;
+        return;
+      }
+
+      _direction = next;
+      for(int admitted = 0; admitted < Capacity && line.size > 0; admitted++) {
+        startCrossing(line.pop());
+      }
+    }
+
+    /**
+     * A cat wakes up, looks at the driveway and goes back to sleep.
+     */
+    void catCheck(int cat) {
+      catChecks++;
+      int on = __builtin_popcountll(_on[0]) + __builtin_popcountll(_on[1]);
+      if(on > Capacity || (_on[0] && _on[1])) {
+        violations++;
+      }
+      if(_now < _end) {
+        _key[Lizards + cat] =
+          keyOf(_now + drawFor(Lizards + cat, { DIST_UNIFORM, (double)_catSleep }), KIND_CAT,
+                Lizards + cat);
+      }
+    }
+};
+
+#endif // SMALLWORLD_H
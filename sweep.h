@@ -0,0 +1,291 @@
+/**
+ * File: sweep.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Multi-process world sweep. A violation (a cat finding toys, a pile-up)
+ * ends the program with exit(-1), which used to throw away every world
+ * run so far. With "-f N" the program instead becomes a supervisor that
+ * forks N worker processes. The workers share one anonymous MAP_SHARED
+ * result region and reserve worlds from it with a single atomic
+ * fetch_add, so no locks are shared between processes.
+ *
+ * Every world has its own slot in the region. While a world runs its
+ * lizards count their crossings into the slot and keep the last few
+ * crossings in a small ring (the trace tail). A world that crashes only
+ * takes its own worker down; the slot, with its partial stats and trace
+ * tail, survives, and the supervisor forks a replacement worker for the
+ * worlds that are still left.
+ *
+ * Workers are forked once and run worlds back to back, so a sweep costs
+ * the same per world as the in-process "-r" loop.
+ */
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>    // For fixed width integers
+#include <stdio.h>     // For printf
+#include <stdlib.h>    // For srandom
+#include <string.h>    // For strncpy
+#include <sys/mman.h>  // For the shared result region
+#include <sys/wait.h>  // For waitpid and WTERMSIG
+#include <unistd.h>    // For fork
+
+#include <atomic>     // For slot reservation and shared stats
+#include <functional> // For the world callback
+
+#include "crosslog.h" // For CrossingRecord and monotonicMicros
+
+#define SWEEP_TRACE_TAIL  16 // Crossings kept per world for post-mortems
+#define SWEEP_REASON_SIZE 64 // Bytes of the violation message kept per world
+
+// Life cycle of one world slot
+enum WorldState {
+  WORLD_PENDING,  // Not reserved yet
+  WORLD_RUNNING,  // Reserved by a worker that is running it
+  WORLD_FINISHED, // Ran to the end of the world
+  WORLD_CRASHED   // Its worker died while running it
+};
+
+// Results of one world, in the shared region
+struct WorldResult {
+  std::atomic<uint32_t> state;                   // WorldState
+  int32_t               worker;                  // Pid of the worker that ran it
+  int32_t               status;                  // waitpid status if it crashed
+  uint32_t              seed;                    // srandom seed of the world
+  uint64_t              start;                   // monotonicMicros() at reservation
+  uint64_t              end;                     // monotonicMicros() when it ended
+  std::atomic<uint64_t> crossings[2];            // Finished crossings per direction
+  std::atomic<uint64_t> waitMicros;              // Total gate wait
+  std::atomic<uint64_t> traced;                  // Crossings ever put in the trace
+  CrossingRecord        trace[SWEEP_TRACE_TAIL]; // Ring of the latest crossings
+  char                  reason[SWEEP_REASON_SIZE]; // Violation, if one was reported
+};
+
+// Header of the shared region, followed by one slot per world
+struct SweepRegion {
+  std::atomic<uint32_t> nextWorld; // Next world to hand out
+  uint32_t              numWorlds; // Worlds in the sweep
+  WorldResult           worlds[1]; // Really numWorlds slots
+};
+
+/**
+ * Runs a sweep of worlds in forked workers and collects their results.
+ * In a worker, the same object gives lizards and cats access to the slot
+ * of the world they live in; outside a sweep every call is a no-op.
+ */
+class WorldSweep {
+  SweepRegion *_region; // Shared result region, NULL outside a sweep
+  size_t       _bytes;  // Size of the mapping
+  WorldResult *_world;  // Slot of the world this worker is running
+
+  public:
+    WorldSweep() : _region(NULL), _bytes(0), _world(NULL) {}
+
+    /**
+     * Counts a finished crossing into the current world and appends it to
+     * its trace tail. Times are relative to the start of the world.
+     */
+    void crossing(uint32_t lizard, uint32_t direction, uint64_t enter, uint64_t wait) {
+      if(!_world) {
+        return;
+      }
+      _world->crossings[direction & 1].fetch_add(1, std::memory_order_relaxed);
+      _world->waitMicros.fetch_add(wait, std::memory_order_relaxed);
+
+      uint64_t slot = _world->traced.fetch_add(1, std::memory_order_relaxed);
+      CrossingRecord record = {
+        lizard, direction, enter - _world->start, monotonicMicros() - _world->start, wait
+      };
+      _world->trace[slot % SWEEP_TRACE_TAIL] = record;
+    }
+
+    /**
+     * Adds finished crossings counted elsewhere to the current world, for
+     * worlds that keep their own totals instead of calling crossing().
+     */
+    void countTotals(const uint64_t crossings[2], uint64_t waitMicros) {
+      if(!_world) {
+        return;
+      }
+      _world->crossings[0].fetch_add(crossings[0], std::memory_order_relaxed);
+      _world->crossings[1].fetch_add(crossings[1], std::memory_order_relaxed);
+      _world->waitMicros.fetch_add(waitMicros, std::memory_order_relaxed);
+    }
+
+    /**
+     * Seed of the world this worker is running, 0 outside a sweep.
+     */
+    uint32_t worldSeed() const { return _world ? _world->seed : 0; }
+
+    /**
+     * Notes why the current world is about to crash. Call right before
+     * exit(-1); the message outlives the worker.
+     */
+    void violation(const char *reason) {
+      if(!_world) {
+        return;
+      }
+      strncpy(_world->reason, reason, SWEEP_REASON_SIZE - 1);
+      _world->end = monotonicMicros();
+    }
+
+    /**
+     * Runs numWorlds worlds on numWorkers forked workers and prints one
+     * line per world plus a trace tail for every crashed world.
+     *
+     * @param numWorkers - Worker processes to keep alive.
+     * @param numWorlds  - Worlds to run.
+     * @param seed       - World w is seeded with srandom(seed + w).
+     * @param runWorld   - Builds, runs and tears down one world.
+     * @return Number of worlds that crashed, or -1 if the sweep could not start.
+     */
+    int run(int numWorkers, int numWorlds, uint32_t seed, const std::function<void()> &runWorld) {
+      _bytes = sizeof(SweepRegion) + (numWorlds - 1) * sizeof(WorldResult);
+      void *region = mmap(NULL, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      if(region == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+      }
+
+      // Anonymous mappings start zeroed: every slot is WORLD_PENDING
+      _region = (SweepRegion *)region;
+      _region->numWorlds = numWorlds;
+      for(int w = 0; w < numWorlds; w++) {
+        _region->worlds[w].seed = seed + w;
+      }
+
+      uint64_t started = monotonicMicros();
+      fflush(stdout);
+      int alive = 0;
+      for(int i = 0; i < numWorkers && i < numWorlds; i++) {
+        alive += spawnWorker(runWorld);
+      }
+
+      // Reap workers; replace any that died while worlds are still left
+      while(alive > 0) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if(pid < 0) {
+          break;
+        }
+        alive--;
+
+        for(int w = 0; w < numWorlds; w++) {
+          WorldResult &world = _region->worlds[w];
+          if(world.worker == pid && world.state.load() == WORLD_RUNNING) {
+            world.status = status;
+            if(!world.end) {
+              world.end = monotonicMicros();
+            }
+            world.state.store(WORLD_CRASHED);
+          }
+        }
+        if(_region->nextWorld.load() < (uint32_t)numWorlds) {
+          alive += spawnWorker(runWorld);
+        }
+      }
+
+      int crashed = printResults(monotonicMicros() - started, numWorkers);
+      munmap(_region, _bytes);
+      _region = NULL;
+      return crashed;
+    }
+
+  private:
+    /**
+     * Forks one worker that reserves and runs worlds until none are left.
+     *
+     * @return 1 if the worker was started, 0 if fork failed.
+     */
+    int spawnWorker(const std::function<void()> &runWorld) {
+      pid_t pid = fork();
+      if(pid < 0) {
+        perror("fork");
+        return 0;
+      }
+      if(pid > 0) {
+        return 1;
+      }
+
+      for(;;) {
+        uint32_t w = _region->nextWorld.fetch_add(1);
+        if(w >= _region->numWorlds) {
+          break;
+        }
+
+        _world = &_region->worlds[w];
+        _world->worker = getpid();
+        _world->start = monotonicMicros();
+        _world->state.store(WORLD_RUNNING);
+        srandom(_world->seed);
+
+        runWorld();
+
+        _world->end = monotonicMicros();
+        _world->state.store(WORLD_FINISHED);
+      }
+
+      fflush(stdout);
+      _exit(0);
+    }
+
+    /**
+     * Prints the per-world table and a trace tail for crashed worlds.
+     *
+     * @return Number of crashed worlds.
+     */
+    int printResults(uint64_t elapsed, int numWorkers) const {
+      int crashed = 0;
+
+      printf("\n%6s %10s %9s %8s %8s %14s %9s\n", "world", "seed", "status",
+             "s->g", "g->s", "mean wait ms", "seconds");
+      for(uint32_t w = 0; w < _region->numWorlds; w++) {
+        const WorldResult &world = _region->worlds[w];
+        uint64_t crossings = world.crossings[0].load() + world.crossings[1].load();
+        uint32_t state = world.state.load();
+
+        printf("%6u %10u %9s %8llu %8llu %14.1f %9.2f\n", w, world.seed,
+               state == WORLD_FINISHED ? "ok" : state == WORLD_CRASHED ? "crashed" : "skipped",
+               (unsigned long long)world.crossings[0].load(),
+               (unsigned long long)world.crossings[1].load(),
+               crossings ? world.waitMicros.load() / 1e3 / crossings : 0.0,
+               world.end > world.start ? (world.end - world.start) / 1e6 : 0.0);
+
+        if(state == WORLD_CRASHED) {
+          crashed++;
+          printTraceTail(world);
+        }
+      }
+
+      printf("%u worlds, %d crashed, %d workers, %.2f s\n", _region->numWorlds, crashed,
+             numWorkers, elapsed / 1e6);
+      fflush(stdout);
+      return crashed;
+    }
+
+    /**
+     * Prints why a world crashed and the crossings leading up to it.
+     */
+    static void printTraceTail(const WorldResult &world) {
+      if(world.reason[0]) {
+        printf("         %s\n", world.reason);
+      } else if(WIFSIGNALED(world.status)) {
+        printf("         killed by signal %d\n", WTERMSIG(world.status));
+      } else {
+        printf("         exited with status %d\n", WEXITSTATUS(world.status));
+      }
+
+      uint64_t traced = world.traced.load();
+      uint64_t first = traced > SWEEP_TRACE_TAIL ? traced - SWEEP_TRACE_TAIL : 0;
+      for(uint64_t i = first; i < traced; i++) {
+        const CrossingRecord &r = world.trace[i % SWEEP_TRACE_TAIL];
+        printf("         lizard %3u %-12s enter %9.3f s  exit %9.3f s  waited %7.3f s\n",
+               r.lizard, r.direction ? "grass->sago" : "sago->grass",
+               r.enter / 1e6, r.exit / 1e6, r.wait / 1e6);
+      }
+    }
+};
+
+#endif // SWEEP_H
@@ -0,0 +1,512 @@
+/**
+ * File: threads.h
+ * Authors: Noah Nickles, Dylan Stephens
+ * Class: COP 4634 Systems & Networks I
+ *
+ * Description:
+ * Control over how lizard and cat threads are created. std::thread gives
+ * every thread the default 8 MB stack, lets it run on any CPU and
+ * schedules it like any other process. With thousands of lizards that
+ * reserves gigabytes of address space, and the scheduler moving threads
+ * between CPUs makes runs of the same world differ more than they
+ * should.
+ *
+ * WorldThread starts a thread through pthread attributes that
+ * ThreadLayout fills in:
+ *   --stack KB     stack size of every lizard and cat thread
+ *   --affinity L   where threads may run; "compact" packs consecutive
+ *                  threads onto neighboring CPUs (hyperthread siblings
+ *                  first), "scatter" deals them out round robin across
+ *                  packages and cores, "node" binds each thread to the
+ *                  CPUs of one NUMA node, round robin over the nodes
+ *   --fifo-cats    run the cats under SCHED_FIFO so an overloaded
+ *                  machine cannot delay their inspections; this needs
+ *                  CAP_SYS_NICE, and cats denied it run as usual
+ *
+ * CPU topology comes from /sys and only covers the CPUs the process may
+ * use. Lizards are threads 0 to n-1 of a world and cats follow them.
+ *
+ * ThreadLayout also reads the resident set size at the end of every
+ * world and the number of crossings each world managed, and prints the
+ * memory used and how much the crossings varied from world to world.
+ */
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <errno.h>   // For EPERM
+#include <limits.h>  // For PTHREAD_STACK_MIN
+#include <math.h>    // For sqrt
+#include <pthread.h> // For thread attributes
+#include <sched.h>   // For CPU sets and SCHED_FIFO
+#include <stdint.h>  // For fixed width integers
+#include <stdio.h>   // For reading /proc and /sys
+#include <stdlib.h>  // For strtol
+#include <string.h>  // For strcmp
+#include <unistd.h>  // For sysconf
+
+#include <algorithm>  // For sorting CPUs
+#include <atomic>     // For the denied counter
+#include <exception>  // For std::terminate
+#include <functional> // For the thread body
+#include <memory>     // For owning the thread body until the thread starts
+#include <vector>     // For the CPU orders
+
+#define THREAD_MAX_NODES 64 // NUMA nodes looked for in /sys
+
+// Where threads may run (--affinity)
+enum Affinity {
+  AFFINITY_NONE,    // Anywhere, as the scheduler likes
+  AFFINITY_COMPACT, // Consecutive threads on neighboring CPUs
+  AFFINITY_SCATTER, // Round robin across packages and cores
+  AFFINITY_NODE     // Round robin over NUMA nodes, anywhere within the node
+};
+
+class ThreadLayout {
+  // One CPU the process may use and where it sits
+  struct Cpu {
+    int id;      // Kernel CPU number
+    int node;    // NUMA node
+    int package; // Physical package (socket)
+    int core;    // Core within the package
+    int sibling; // Rank among the hyperthreads of its core
+    int rank;    // Rank of its core within the package
+  };
+
+  size_t                 _stackBytes; // Stack per thread, 0 for the default
+  Affinity               _affinity;
+  bool                   _fifoCats;   // Cats run under SCHED_FIFO
+  int                    _threads;    // Threads in the current world
+  std::vector<int>       _compact;    // CPUs in compact order
+  std::vector<int>       _scatter;    // CPUs in scatter order
+  std::vector<cpu_set_t> _nodes;      // CPUs of every node with allowed CPUs
+  std::atomic<uint64_t>  _fifoDenied; // Cats that could not get SCHED_FIFO
+
+  std::vector<long>     _rssKB;     // Resident set at the end of every world
+  std::vector<long>     _vmKB;      // Address space at the end of every world
+  std::vector<uint64_t> _crossings; // Crossings of every world
+  uint64_t              _counted;   // Crossings up to the last world
+
+  public:
+    ThreadLayout() : _stackBytes(0), _affinity(AFFINITY_NONE), _fifoCats(false), _threads(1),
+                     _fifoDenied(0), _counted(0) {}
+
+    /**
+     * Sets the stack size in kilobytes. Sizes below the minimum a thread
+     * needs are raised to it.
+     *
+     * @return false if the size is not a positive number.
+     */
+    bool setStack(const char *kilobytes) {
+      char *end;
+      long kb = strtol(kilobytes, &end, 10);
+      if(end == kilobytes || *end || kb <= 0) {
+        return false;
+      }
+      long page = sysconf(_SC_PAGESIZE);
+      _stackBytes = std::max((size_t)kb * 1024, (size_t)PTHREAD_STACK_MIN);
+      _stackBytes = (_stackBytes + page - 1) / page * page;
+      return true;
+    }
+
+    /**
+     * Sets the affinity layout from its name and reads the CPU topology.
+     *
+     * @return false if the name is not compact, scatter or node.
+     */
+    bool setAffinity(const char *name) {
+      if(strcmp(name, "compact") == 0) {
+        _affinity = AFFINITY_COMPACT;
+      } else if(strcmp(name, "scatter") == 0) {
+        _affinity = AFFINITY_SCATTER;
+      } else if(strcmp(name, "node") == 0) {
+        _affinity = AFFINITY_NODE;
+      } else {
+        return false;
+      }
+      readTopology();
+      return true;
+    }
+
+    void enableFifoCats() { _fifoCats = true; }
+
+    bool isOn() const { return _stackBytes || _affinity != AFFINITY_NONE || _fifoCats; }
+
+    /**
+     * Tells the layout how many threads the next world starts, so
+     * compact can spread them evenly over the CPUs.
+     */
+    void prepare(int threads) { _threads = threads > 0 ? threads : 1; }
+
+    /**
+     * Starts thread number index of the world with the configured stack,
+     * affinity and scheduling.
+     *
+     * @return 0, or the error of pthread_create.
+     */
+    int create(pthread_t &handle, void *(*body)(void *), void *arg, int index, bool cat) {
+      pthread_attr_t attr;
+      pthread_attr_init(&attr);
+      if(_stackBytes) {
+        pthread_attr_setstacksize(&attr, _stackBytes);
+      }
+
+      cpu_set_t cpus;
+      if(cpusFor(index, cpus)) {
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+      }
+
+      int error;
+      if(cat && _fifoCats) {
+        struct sched_param param;
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+        error = pthread_create(&handle, &attr, body, arg);
+        if(error == EPERM) {
+          // Not allowed to use real-time scheduling; run the cat as usual
+          _fifoDenied.fetch_add(1, std::memory_order_relaxed);
+          pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+          error = pthread_create(&handle, &attr, body, arg);
+        }
+      } else {
+        error = pthread_create(&handle, &attr, body, arg);
+      }
+      pthread_attr_destroy(&attr);
+      return error;
+    }
+
+    /**
+     * Reads the resident set and address space sizes while the threads
+     * of a world are still alive. Call right before the world ends.
+     */
+    void sampleMemory() {
+      _rssKB.push_back(statusKB("VmRSS:"));
+      _vmKB.push_back(statusKB("VmSize:"));
+    }
+
+    /**
+     * Counts the crossings of the world that just ended.
+     *
+     * @param total - Crossings of every world so far.
+     */
+    void countWorld(uint64_t total) {
+      _crossings.push_back(total - _counted);
+      _counted = total;
+    }
+
+    /**
+     * Prints how the threads were created, the memory they used and how
+     * much the crossings varied from world to world.
+     *
+     * @param threads - Threads of one world.
+     */
+    void printSummary(int threads) const {
+      if(!isOn() && _crossings.size() < 2) {
+        return;
+      }
+
+      static const char *layouts[] = { "any CPU", "compact", "scatter", "node" };
+      printf("\nthreads: %d per world, ", threads);
+      if(_stackBytes) {
+        printf("%zu KB stacks, ", _stackBytes / 1024);
+      } else {
+        printf("default stacks, ");
+      }
+      printf("%s", layouts[_affinity]);
+      if(_affinity == AFFINITY_NODE) {
+        printf(" (%zu nodes)", _nodes.size());
+      } else if(_affinity != AFFINITY_NONE) {
+        printf(" (%zu CPUs)", _compact.size());
+      }
+      if(_fifoCats) {
+        uint64_t denied = _fifoDenied.load();
+        printf(", cats SCHED_FIFO");
+        if(denied) {
+          printf(" (denied %llu times, ran as usual)", (unsigned long long)denied);
+        }
+      }
+      printf("\n");
+
+      if(!_rssKB.empty()) {
+        double rss = 0, vm = 0;
+        for(size_t i = 0; i < _rssKB.size(); i++) {
+          rss += _rssKB[i];
+          vm += _vmKB[i];
+        }
+        printf("memory: %.1f MB resident and %.1f MB mapped at the end of a world, peak %.1f MB resident\n",
+               rss / _rssKB.size() / 1024, vm / _vmKB.size() / 1024, statusKB("VmHWM:") / 1024.0);
+      }
+
+      if(!_crossings.empty()) {
+        double mean = 0;
+        for(uint64_t crossings : _crossings) {
+          mean += crossings;
+        }
+        mean /= _crossings.size();
+        double squares = 0;
+        for(uint64_t crossings : _crossings) {
+          squares += (crossings - mean) * (crossings - mean);
+        }
+        if(_crossings.size() > 1) {
+          double deviation = sqrt(squares / (_crossings.size() - 1));
+          printf("crossings per world: mean %.1f, stddev %.1f (%.1f%%) over %zu worlds\n", mean,
+                 deviation, mean > 0 ? 100 * deviation / mean : 0.0, _crossings.size());
+        } else {
+          printf("crossings: %.0f in one world; run -r worlds for the variance\n", mean);
+        }
+      }
+      fflush(stdout);
+    }
+
+  private:
+    /**
+     * Picks the CPUs thread number index may run on.
+     *
+     * @return false if the thread may run anywhere.
+     */
+    bool cpusFor(int index, cpu_set_t &cpus) const {
+      CPU_ZERO(&cpus);
+      switch(_affinity) {
+        case AFFINITY_COMPACT:
+          if(_compact.empty()) {
+            return false;
+          }
+          // Spread the threads evenly over the compact order: thread i of n
+          // gets CPU (i * cpus) / n, so neighbors share cores
+          CPU_SET(_compact[((size_t)index % _threads) * _compact.size() / _threads], &cpus);
+          return true;
+        case AFFINITY_SCATTER:
+          if(_scatter.empty()) {
+            return false;
+          }
+          CPU_SET(_scatter[(size_t)index % _scatter.size()], &cpus);
+          return true;
+        case AFFINITY_NODE:
+          if(_nodes.empty()) {
+            return false;
+          }
+          cpus = _nodes[(size_t)index % _nodes.size()];
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    /**
+     * Reads where every CPU the process may use sits and orders them for
+     * the compact and scatter layouts.
+     */
+    void readTopology() {
+      cpu_set_t allowed;
+      if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
+      }
+
+      // The NUMA node of every CPU; without /sys/devices/system/node there is one
+      std::vector<cpu_set_t> nodes;
+      for(int node = 0; node < THREAD_MAX_NODES; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        cpu_set_t cpus;
+        if(readCpuList(path, cpus)) {
+          CPU_AND(&cpus, &cpus, &allowed);
+          nodes.push_back(cpus);
+        }
+      }
+
+      std::vector<Cpu> found;
+      for(int id = 0; id < CPU_SETSIZE; id++) {
+        if(!CPU_ISSET(id, &allowed)) {
+          continue;
+        }
+        Cpu cpu = { id, 0, topologyValue(id, "physical_package_id"),
+                    topologyValue(id, "core_id"), 0, 0 };
+        for(size_t node = 0; node < nodes.size(); node++) {
+          if(CPU_ISSET(id, &nodes[node])) {
+            cpu.node = (int)node;
+          }
+        }
+        found.push_back(cpu);
+      }
+
+      // Compact: node by node, core by core, hyperthread siblings together
+      std::sort(found.begin(), found.end(), [](const Cpu &a, const Cpu &b) {
+        if(a.node != b.node) return a.node < b.node;
+        if(a.package != b.package) return a.package < b.package;
+        if(a.core != b.core) return a.core < b.core;
+        return a.id < b.id;
+      });
+      for(size_t i = 0; i < found.size(); i++) {
+        if(i > 0 && found[i].package == found[i - 1].package && found[i].core == found[i - 1].core) {
+          found[i].sibling = found[i - 1].sibling + 1;
+          found[i].rank = found[i - 1].rank;
+        } else if(i > 0 && found[i].package == found[i - 1].package) {
+          found[i].rank = found[i - 1].rank + 1;
+        }
+      }
+      _compact.clear();
+      for(const Cpu &cpu : found) {
+        _compact.push_back(cpu.id);
+      }
+
+      // Scatter: one hyperthread of every core first, alternating packages
+      std::sort(found.begin(), found.end(), [](const Cpu &a, const Cpu &b) {
+        if(a.sibling != b.sibling) return a.sibling < b.sibling;
+        if(a.rank != b.rank) return a.rank < b.rank;
+        if(a.package != b.package) return a.package < b.package;
+        return a.id < b.id;
+      });
+      _scatter.clear();
+      for(const Cpu &cpu : found) {
+        _scatter.push_back(cpu.id);
+      }
+
+      // Nodes without any allowed CPU cannot take threads
+      _nodes.clear();
+      for(const cpu_set_t &cpus : nodes) {
+        if(CPU_COUNT(&cpus) > 0) {
+          _nodes.push_back(cpus);
+        }
+      }
+      if(_nodes.empty()) {
+        _nodes.push_back(allowed);
+      }
+    }
+
+    /**
+     * Reads a topology value of a CPU from /sys, 0 if it is missing.
+     */
+    static int topologyValue(int cpu, const char *name) {
+      char path[96];
+      snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+      FILE *file = fopen(path, "r");
+      int value = 0;
+      if(file) {
+        if(fscanf(file, "%d", &value) != 1 || value < 0) {
+          value = 0;
+        }
+        fclose(file);
+      }
+      return value;
+    }
+
+    /**
+     * Reads a CPU list like "0-3,8-11" from a file.
+     *
+     * @return false if the file cannot be read.
+     */
+    static bool readCpuList(const char *path, cpu_set_t &cpus) {
+      FILE *file = fopen(path, "r");
+      if(!file) {
+        return false;
+      }
+      CPU_ZERO(&cpus);
+      int first, last;
+      while(fscanf(file, "%d", &first) == 1) {
+        last = first;
+        int next = fgetc(file);
+        if(next == '-') {
+          if(fscanf(file, "%d", &last) != 1) {
+            break;
+          }
+          next = fgetc(file);
+        }
+        for(int id = first; id <= last && id < CPU_SETSIZE; id++) {
+          CPU_SET(id, &cpus);
+        }
+        if(next != ',') {
+          break;
+        }
+      }
+      fclose(file);
+      return true;
+    }
+
+    /**
+     * Reads a value in kB from /proc/self/status, 0 if it is missing.
+     */
+    static long statusKB(const char *field) {
+      FILE *file = fopen("/proc/self/status", "r");
+      if(!file) {
+        return 0;
+      }
+      char line[256];
+      long kb = 0;
+      size_t length = strlen(field);
+      while(fgets(line, sizeof(line), file)) {
+        if(strncmp(line, field, length) == 0) {
+          kb = strtol(line + length, NULL, 10);
+          break;
+        }
+      }
+      fclose(file);
+      return kb;
+    }
+};
+
+extern ThreadLayout threadLayout; // Defined by the program, set from the command line
+
+/**
+ * A lizard or cat thread started through threadLayout. Used like the
+ * std::thread it replaces: start() once, then join(). Like std::thread,
+ * destroying or restarting a thread that was never joined calls
+ * std::terminate().
+ */
+class WorldThread {
+  pthread_t _handle;
+  bool      _joinable;
+
+  public:
+    WorldThread() : _handle(), _joinable(false) {}
+    WorldThread(WorldThread &&other) : _handle(other._handle), _joinable(other._joinable) {
+      other._handle = pthread_t();
+      other._joinable = false;
+    }
+    WorldThread(const WorldThread &) = delete;
+    WorldThread &operator=(const WorldThread &) = delete;
+    ~WorldThread() {
+      if(_joinable) {
+        std::terminate();
+      }
+    }
+
+    /**
+     * Starts the thread running body. The body is moved to the heap and
+     * the new thread deletes it when done; if the thread cannot be
+     * created it is deleted here.
+     *
+     * @param index - Number of the thread in its world.
+     * @param cat   - The thread is a cat (for --fifo-cats).
+     * @return false if the thread could not be created.
+     */
+    bool start(std::function<void()> body, int index, bool cat) {
+      if(_joinable) {
+        std::terminate();
+      }
+      std::unique_ptr<std::function<void()>> owned(new std::function<void()>(std::move(body)));
+      if(threadLayout.create(_handle, trampoline, owned.get(), index, cat) != 0) {
+        return false;
+      }
+      owned.release(); // The thread owns the body now
+      _joinable = true;
+      return true;
+    }
+
+    bool joinable() const { return _joinable; }
+
+    void join() {
+      pthread_join(_handle, NULL);
+      _joinable = false;
+    }
+
+  private:
+    static void *trampoline(void *arg) {
+      std::function<void()> *body = (std::function<void()> *)arg;
+      (*body)();
+      delete body;
+      return NULL;
+    }
+};
+
+#endif // THREADS_H